@@ -3,6 +3,23 @@
 IMAGE_KERNEL = $(word 1,$^)
 IMAGE_ROOTFS = $(word 2,$^)
 
+# Cache for steps whose output only depends on the input file and their
+# arguments, shared between devices and across incremental builds.
+# Set IMAGE_CACHE_DIR to an empty value to disable it. The least recently
+# used entries are removed after each image build to keep it below
+# IMAGE_CACHE_SIZE MiB.
+IMAGE_CACHE_DIR ?= $(KDIR)/image-cache
+IMAGE_CACHE_SIZE ?= 512
+
+##@
+# @brief Run a build command through the image step cache.
+#
+# @param 1: Command reading $@ and writing $@.new.
+##
+define cached_cmd
+$(if $(IMAGE_CACHE_DIR),$(SCRIPT_DIR)/image-cache.sh $(IMAGE_CACHE_DIR) $@ $@.new "$(subst ",\",$(1))",$(1))
+endef
+
 define ModelNameLimit16
 $(shell printf %.16s "$(word 2, $(subst _, ,$(1)))")
 endef
@@ -455,12 +472,12 @@ define Build/fit
 endef
 
 define Build/libdeflate-gzip
-	$(STAGING_DIR_HOST)/bin/libdeflate-gzip -f -12 -c $@ $(1) > $@.new
+	$(call cached_cmd,$(STAGING_DIR_HOST)/bin/libdeflate-gzip -f -12 -c $@ $(1) > $@.new)
 	@mv $@.new $@
 endef
 
 define Build/gzip
-	$(STAGING_DIR_HOST)/bin/gzip -f -9n -c $@ $(1) > $@.new
+	$(call cached_cmd,$(STAGING_DIR_HOST)/bin/gzip -f -9n -c $@ $(1) > $@.new)
 	@mv $@.new $@
 endef
 
@@ -581,7 +598,7 @@ define Build/lzma
 endef
 
 define Build/lzma-no-dict
-	$(STAGING_DIR_HOST)/bin/lzma e $@ $(1) $@.new
+	$(call cached_cmd,$(STAGING_DIR_HOST)/bin/lzma e $@ $(1) $@.new)
 	@mv $@.new $@
 endef
 
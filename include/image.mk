@@ -999,5 +999,6 @@ define BuildImage
 
   install: install-images
 	$(call Image/Manifest)
+	$(if $(IMAGE_CACHE_DIR),$(SCRIPT_DIR)/image-cache.sh --stats $(IMAGE_CACHE_DIR) $(IMAGE_CACHE_SIZE))
 
 endef
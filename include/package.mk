@@ -252,29 +252,37 @@ define Build/CoreTargets
 	@-rm -rf $(PKG_BUILD_DIR)
 	@mkdir -p $(PKG_BUILD_DIR)
 	touch $$@_check
+	$(call profile_phase,prepare,start)
 	$(foreach hook,$(Hooks/Prepare/Pre),$(call $(hook))$(sep))
 	$(Build/Prepare)
 	$(foreach hook,$(Hooks/Prepare/Post),$(call $(hook))$(sep))
+	$(call profile_phase,prepare,end)
 	touch $$@
 
   $(call Build/Exports,$(STAMP_CONFIGURED))
   $(STAMP_CONFIGURED): $(STAMP_PREPARED) $(STAMP_CONFIGURED_DEPENDS)
 	rm -f $(STAMP_CONFIGURED_WILDCARD)
 	$(CleanStaging)
+	$(call profile_phase,configure,start)
 	$(foreach hook,$(Hooks/Configure/Pre),$(call $(hook))$(sep))
 	$(Build/Configure)
 	$(foreach hook,$(Hooks/Configure/Post),$(call $(hook))$(sep))
+	$(call profile_phase,configure,end)
 	touch $$@
 
   $(call Build/Exports,$(STAMP_BUILT))
   $(STAMP_BUILT): $(STAMP_CONFIGURED) $(STAMP_BUILT_DEPENDS)
 	rm -f $$@
 	touch $$@_check
+	$(call profile_phase,compile,start)
 	$(foreach hook,$(Hooks/Compile/Pre),$(call $(hook))$(sep))
 	$(Build/Compile)
 	$(foreach hook,$(Hooks/Compile/Post),$(call $(hook))$(sep))
+	$(call profile_phase,compile,end)
+	$(call profile_phase,install,start)
 	$(Build/Install)
 	$(foreach hook,$(Hooks/Install/Post),$(call $(hook))$(sep))
+	$(call profile_phase,install,end)
 	touch $$@
 
   $(STAMP_INSTALLED) : export PATH=$$(TARGET_PATH_PKG)
@@ -0,0 +1,19 @@
+# SPDX-License-Identifier: GPL-2.0-only
+#
+# Copyright (C) 2025 OpenWrt.org
+
+# Loaded through MAKEFILES by include/scan.mk for every DUMP=1 make process,
+# including sub-makes. Records the makefiles which were read for the dump,
+# so the scan cache entry is only reused while none of them changed.
+#
+# Makefiles are remade after all of them have been read, so the recipe of
+# this rule sees the complete MAKEFILE_LIST. It does not change the file,
+# so make does not restart.
+
+ifneq ($(SCAN_DEPS_FILE),)
+$(lastword $(MAKEFILE_LIST)): FORCE_SCAN_DEPS
+	$(file >>$(SCAN_DEPS_FILE),$(filter-out $(TOPDIR)/.config $(TOPDIR)/tmp/%,$(wildcard $(abspath $(MAKEFILE_LIST)))))
+
+FORCE_SCAN_DEPS:
+.PHONY: FORCE_SCAN_DEPS
+endif
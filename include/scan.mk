@@ -10,6 +10,21 @@ SCAN_DIR ?= package
 TARGET_STAMP:=$(TMP_DIR)/info/.files-$(SCAN_TARGET).stamp
 FILELIST:=$(TMP_DIR)/info/.files-$(SCAN_TARGET)-$(SCAN_COOKIE)
 OVERRIDELIST:=$(TMP_DIR)/info/.overrides-$(SCAN_TARGET)-$(SCAN_COOKIE)
+SCAN_STATS:=$(TMP_DIR)/info/.stats-$(SCAN_TARGET)-$(SCAN_COOKIE)
+
+# Dump output of each Makefile is cached by content hash, so that a fresh
+# tmp/ or touched files only require re-dumping Makefiles that changed.
+# Each entry records all makefiles read for the dump (see scan-deps.mk)
+# and is only used while their content is unchanged. Entries not used for
+# SCAN_CACHE_DAYS are removed after the scan.
+SCAN_CACHE_DIR ?= $(TOPDIR)/.scan-cache
+SCAN_CACHE_DAYS ?= 30
+
+# set once, the recipes below must not re-evaluate it
+ifeq ($(SCAN_START),)
+  SCAN_START := $(shell date +%s)
+endif
+export SCAN_START
 
 export ORIG_PATH:=$(if $(ORIG_PATH),$(ORIG_PATH),$(PATH))
 export PATH:=$(STAGING_DIR_HOST)/bin:$(PATH)
@@ -46,24 +61,51 @@ endif
 define PackageDir
   $(TMP_DIR)/.$(SCAN_TARGET): $(TMP_DIR)/info/.$(SCAN_TARGET)-$(1)
   $(TMP_DIR)/info/.$(SCAN_TARGET)-$(1): $(SCAN_DIR)/$(2)/Makefile $(foreach DEP,$(DEPS_$(SCAN_DIR)/$(2)/Makefile) $(SCAN_DEPS),$(wildcard $(if $(filter /%,$(DEP)),$(DEP),$(SCAN_DIR)/$(2)/$(DEP))))
+	$(if $(SCAN_CACHE_DIR), \
+		KEY=$$$$( { echo "$(SCAN_DIR)/$(2) $(3) $(SCAN_MAKEOPTS)"; cat $$^; } | $(MKHASH) md5); \
+		CACHE="$(SCAN_CACHE_DIR)/$(SCAN_TARGET)/$$$$KEY"; \
+		if [ -s "$$$$CACHE" ] && { read SUM FILES; } 2>/dev/null < "$$$$CACHE.deps" && \
+		   [ "$$$$(cat $$$$FILES 2>/dev/null | $(MKHASH) md5)" = "$$$$SUM" ]; then \
+			touch "$$$$CACHE" "$$$$CACHE.deps"; \
+			cp "$$$$CACHE" $$@; \
+			echo hit >> $(SCAN_STATS); \
+			exit 0; \
+		fi; \
+		rm -f $$@.files; \
+	) \
+	DUMP_OK=1; \
 	{ \
 		$$(call progress,Collecting $(SCAN_NAME) info: $(SCAN_DIR)/$(2)) \
 		echo Source-Makefile: $(SCAN_DIR)/$(2)/Makefile; \
 		$(if $(3),echo Override: $(3),true); \
+		$(if $(SCAN_CACHE_DIR),MAKEFILES=$(TOPDIR)/include/scan-deps.mk SCAN_DEPS_FILE=$$@.files) \
 		$(if $(findstring c,$(OPENWRT_VERBOSE)),$(MAKE),$(NO_TRACE_MAKE) --no-print-dir) -r DUMP=1 FEED="$(call feedname,$(2))" -C $(SCAN_DIR)/$(2) $(SCAN_MAKEOPTS) \
 			$(if $(findstring c,$(OPENWRT_VERBOSE)),,2>/dev/null) || { \
+			DUMP_OK=; \
 			mkdir -p "$(TOPDIR)/logs/$(SCAN_DIR)/$(2)"; \
 			$(NO_TRACE_MAKE) --no-print-dir -r DUMP=1 FEED="$(call feedname,$(2))" -C $(SCAN_DIR)/$(2) $(SCAN_MAKEOPTS) > $(TOPDIR)/logs/$(SCAN_DIR)/$(2)/dump.txt 2>&1; \
 			$$(call progress,ERROR: please fix $(SCAN_DIR)/$(2)/Makefile - see logs/$(SCAN_DIR)/$(2)/dump.txt for details\n) \
 			rm -f $$@; \
 		}; \
 		echo; \
-	} > $$@.tmp
+	} > $$@.tmp; \
+	echo miss >> $(SCAN_STATS); \
+	$(if $(SCAN_CACHE_DIR), \
+		[ -z "$$$$DUMP_OK" -o ! -s $$@.files ] || { \
+			FILES=$$$$(tr ' ' '\n' < $$@.files | sort -u | tr '\n' ' '); \
+			SUM=$$$$(cat $$$$FILES 2>/dev/null | $(MKHASH) md5); \
+			mkdir -p "$(SCAN_CACHE_DIR)/$(SCAN_TARGET)"; \
+			cp $$@.tmp "$$$$CACHE.$$$$$$$$" && \
+			echo "$$$$SUM $$$$FILES" > "$$$$CACHE.deps" && \
+			mv "$$$$CACHE.$$$$$$$$" "$$$$CACHE"; \
+		}; \
+		rm -f $$@.files; \
+	) \
 	mv $$@.tmp $$@
 endef
 
 $(OVERRIDELIST):
-	rm -f $(TMP_DIR)/info/.overrides-$(SCAN_TARGET)-*
+	rm -f $(TMP_DIR)/info/.overrides-$(SCAN_TARGET)-* $(TMP_DIR)/info/.stats-$(SCAN_TARGET)-*
 	touch $@
 
 ifeq ($(SCAN_NAME),target)
@@ -116,7 +158,15 @@ $(TMP_DIR)/.$(SCAN_TARGET): $(TARGET_STAMP)
 	-cat $(FILELIST) | awk '{gsub(/\//, "_", $$0);print "$(TMP_DIR)/info/.$(SCAN_TARGET)-" $$0}' | xargs cat > $@ 2>/dev/null
 	$(call progress,Collecting $(SCAN_NAME) info: done)
 	echo
+	[ ! -s $(SCAN_STATS) ] || awk -v start=$(SCAN_START) -v now=$$(date +%s) -v name="$(SCAN_NAME)" ' \
+		{ n[$$1]++ } \
+		END { \
+			total = n["hit"] + n["miss"]; \
+			printf "Collecting %s info: %d scanned, %d cached (%d%%), %ds\n", \
+				name, total, n["hit"], n["hit"] * 100 / total, now - start > "/dev/stderr" \
+		}' $(SCAN_STATS)
+	rm -f $(SCAN_STATS)
+	$(if $(SCAN_CACHE_DIR),-find "$(SCAN_CACHE_DIR)/$(SCAN_TARGET)" -type f -mtime +$(SCAN_CACHE_DAYS) -delete 2>/dev/null)
 
 FORCE:
 .PHONY: FORCE
-.NOTPARALLEL:
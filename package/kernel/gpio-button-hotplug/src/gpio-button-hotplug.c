@@ -22,6 +22,11 @@
 #include <linux/skbuff.h>
 #include <linux/netlink.h>
 #include <linux/kobject.h>
+#include <linux/debugfs.h>
+#include <linux/miscdevice.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/seq_file.h>
 #include <linux/input.h>
 #include <linux/interrupt.h>
 #include <linux/platform_device.h>
@@ -31,6 +36,8 @@
 #include <linux/gpio/consumer.h>
 
 #define BH_SKB_SIZE	2048
+#define BH_QUEUE_LEN	64	/* must be a power of 2 */
+#define BH_LINE_SIZE	64
 
 #define DRV_NAME	"gpio-keys"
 #define PFX	DRV_NAME ": "
@@ -50,11 +57,32 @@ struct bh_map {
 	const char	*name;
 };
 
+struct bh_record {
+	u64		seq;
+	const char	*name;
+	unsigned int	type;
+	unsigned long	seen;
+	int		pressed;
+};
+
+struct bh_button_stats {
+	unsigned long	changes;	/* debounced state changes */
+	unsigned long	events;		/* events reported to userspace */
+	unsigned long	coalesced;	/* changes merged into other events */
+	unsigned long	presses;
+	unsigned long	max_hold;	/* longest press in seconds */
+};
+
 struct gpio_keys_button_data {
 	struct delayed_work work;
+	struct delayed_work report_work;
+	struct mutex lock;
 	unsigned long seen;
+	unsigned long changed;
 	int map_entry;
 	int last_state;
+	int reported_state;
+	bool report_pending;
 	int count;
 	int threshold;
 	int can_sleep;
@@ -62,10 +90,27 @@ struct gpio_keys_button_data {
 	unsigned int software_debounce;
 	struct gpio_desc *gpiod;
 	const struct gpio_keys_button *b;
+	struct bh_button_stats stats;
 };
 
 extern u64 uevent_next_seqnum(void);
 
+static unsigned int coalesce_ms = 20;
+module_param(coalesce_ms, uint, 0644);
+MODULE_PARM_DESC(coalesce_ms,
+		 "Merge button state changes within this time in ms (0 to disable)");
+
+/*
+ * Event queue for /dev/button-events, so that a daemon can consume the
+ * button events without a hotplug handler being spawned for every event.
+ */
+static DEFINE_SPINLOCK(bh_queue_lock);
+static DECLARE_WAIT_QUEUE_HEAD(bh_queue_wait);
+static struct bh_record bh_queue[BH_QUEUE_LEN];
+static u64 bh_queue_seq;
+
+static struct dentry *bh_debugfs_dir;
+
 #define BH_MAP(_code, _name)		\
 	{				\
 		.code = (_code),	\
@@ -105,6 +150,136 @@ static struct bh_map button_map[] = {
 
 /* -------------------------------------------------------------------------*/
 
+static void bh_queue_add(const char *name, unsigned int type,
+			 unsigned long seen, int pressed)
+{
+	struct bh_record *rec;
+
+	spin_lock(&bh_queue_lock);
+	rec = &bh_queue[bh_queue_seq & (BH_QUEUE_LEN - 1)];
+	rec->seq = bh_queue_seq++;
+	rec->name = name;
+	rec->type = type;
+	rec->seen = seen;
+	rec->pressed = pressed;
+	spin_unlock(&bh_queue_lock);
+
+	wake_up_interruptible(&bh_queue_wait);
+}
+
+static bool bh_queue_pending(u64 seq)
+{
+	bool ret;
+
+	spin_lock(&bh_queue_lock);
+	ret = seq != bh_queue_seq;
+	spin_unlock(&bh_queue_lock);
+
+	return ret;
+}
+
+static int bh_queue_open(struct inode *inode, struct file *file)
+{
+	int ret;
+
+	ret = nonseekable_open(inode, file);
+	if (ret)
+		return ret;
+
+	/* readers only get the events queued after opening the device */
+	spin_lock(&bh_queue_lock);
+	file->f_pos = bh_queue_seq;
+	spin_unlock(&bh_queue_lock);
+
+	return 0;
+}
+
+/*
+ * Every event is returned as one line: "<seq> <button> <action> <seen>",
+ * followed by " switch" for switches. A gap in the sequence numbers means
+ * that the reader was too slow and events were dropped.
+ */
+static ssize_t bh_queue_read(struct file *file, char __user *buf,
+			     size_t count, loff_t *ppos)
+{
+	char line[BH_LINE_SIZE];
+	ssize_t done = 0;
+	int ret;
+
+	if (!count)
+		return 0;
+
+	if (!(file->f_flags & O_NONBLOCK)) {
+		ret = wait_event_interruptible(bh_queue_wait,
+					       bh_queue_pending(*ppos));
+		if (ret)
+			return ret;
+	}
+
+	while (done < count) {
+		struct bh_record rec;
+		u64 seq = *ppos;
+		int len;
+
+		spin_lock(&bh_queue_lock);
+		if (seq == bh_queue_seq) {
+			spin_unlock(&bh_queue_lock);
+			break;
+		}
+
+		/* skip the events which were overwritten in the meantime */
+		if (bh_queue_seq - seq > BH_QUEUE_LEN)
+			seq = bh_queue_seq - BH_QUEUE_LEN;
+		rec = bh_queue[seq & (BH_QUEUE_LEN - 1)];
+		spin_unlock(&bh_queue_lock);
+
+		len = scnprintf(line, sizeof(line), "%llu %s %s %lu%s\n",
+				rec.seq, rec.name,
+				rec.pressed ? "pressed" : "released", rec.seen,
+				rec.type == EV_SW ? " switch" : "");
+		if (len > count - done) {
+			if (!done)
+				return -EINVAL;
+			break;
+		}
+
+		if (copy_to_user(buf + done, line, len))
+			return done ? done : -EFAULT;
+
+		done += len;
+		*ppos = seq + 1;
+	}
+
+	if (!done)
+		return -EAGAIN;
+
+	return done;
+}
+
+static __poll_t bh_queue_poll(struct file *file, poll_table *wait)
+{
+	poll_wait(file, &bh_queue_wait, wait);
+
+	return bh_queue_pending(file->f_pos) ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+static const struct file_operations bh_queue_fops = {
+	.owner		= THIS_MODULE,
+	.open		= bh_queue_open,
+	.read		= bh_queue_read,
+	.poll		= bh_queue_poll,
+	.llseek		= noop_llseek,
+};
+
+static struct miscdevice bh_queue_dev = {
+	.minor		= MISC_DYNAMIC_MINOR,
+	.name		= "button-events",
+	.fops		= &bh_queue_fops,
+	.mode		= 0400,
+};
+
+/* -------------------------------------------------------------------------*/
+
 static __printf(3, 4)
 int bh_event_add_var(struct bh_event *event, int argv, const char *format, ...)
 {
@@ -210,6 +385,8 @@ static int button_hotplug_create_event(const char *name, unsigned int type,
 	pr_debug(PFX "create event, name=%s, seen=%lu, pressed=%d\n",
 		 name, seen, pressed);
 
+	bh_queue_add(name, type, seen, pressed);
+
 	event = kzalloc(sizeof(*event), GFP_KERNEL);
 	if (!event)
 		return -ENOMEM;
@@ -250,6 +427,49 @@ static int gpio_button_get_value(struct gpio_keys_button_data *bdata)
 	return val;
 }
 
+static void gpio_keys_report(struct gpio_keys_button_data *bdata,
+			     unsigned int type, int state, unsigned long now)
+{
+	unsigned long seen;
+
+	if (bdata->seen == 0)
+		bdata->seen = now;
+	seen = (now - bdata->seen) / HZ;
+
+	bdata->stats.events++;
+	if (type == EV_KEY) {
+		if (state)
+			bdata->stats.presses++;
+		else if (seen > bdata->stats.max_hold)
+			bdata->stats.max_hold = seen;
+	}
+
+	button_hotplug_create_event(button_map[bdata->map_entry].name, type,
+				    seen, state);
+	bdata->seen = now;
+	bdata->reported_state = state;
+}
+
+static void gpio_keys_report_work_func(struct work_struct *work)
+{
+	struct gpio_keys_button_data *bdata = container_of(work,
+		struct gpio_keys_button_data, report_work.work);
+	unsigned int type = bdata->b->type ?: EV_KEY;
+
+	mutex_lock(&bdata->lock);
+	if (bdata->report_pending) {
+		bdata->report_pending = false;
+
+		/* the button went back to the reported state in the meantime */
+		if (bdata->last_state == bdata->reported_state)
+			bdata->stats.coalesced++;
+		else
+			gpio_keys_report(bdata, type, bdata->last_state,
+					 bdata->changed);
+	}
+	mutex_unlock(&bdata->lock);
+}
+
 static void gpio_keys_handle_button(struct gpio_keys_button_data *bdata)
 {
 	unsigned int type = bdata->b->type ?: EV_KEY;
@@ -259,6 +479,8 @@ static void gpio_keys_handle_button(struct gpio_keys_button_data *bdata)
 	pr_debug(PFX "event type=%u, code=%u, pressed=%d\n",
 		 type, bdata->b->code, state);
 
+	mutex_lock(&bdata->lock);
+
 	/* is this the initialization state? */
 	if (bdata->last_state == -1) {
 		/*
@@ -266,8 +488,10 @@ static void gpio_keys_handle_button(struct gpio_keys_button_data *bdata)
 		 * Just save their state and continue otherwise this
 		 * can cause OpenWrt to enter failsafe.
 		 */
-		if (type == EV_KEY && state == 0)
+		if (type == EV_KEY && state == 0) {
+			bdata->reported_state = state;
 			goto set_state;
+		}
 		/*
 		 * But we are very interested in pressed buttons and
 		 * initial switch state. These will be reported to
@@ -276,24 +500,39 @@ static void gpio_keys_handle_button(struct gpio_keys_button_data *bdata)
 	} else if (bdata->last_state == state) {
 		/* reset asserted counter (only relevant for polled keys) */
 		bdata->count = 0;
-		return;
+		goto out;
 	}
 
 	if (bdata->count < bdata->threshold) {
 		bdata->count++;
-		return;
+		goto out;
 	}
 
-	if (bdata->seen == 0)
-		bdata->seen = seen;
+	bdata->stats.changes++;
 
-	button_hotplug_create_event(button_map[bdata->map_entry].name, type,
-				    (seen - bdata->seen) / HZ, state);
-	bdata->seen = seen;
+	if (coalesce_ms && bdata->last_state != -1) {
+		/*
+		 * Report the change once the state was stable for
+		 * coalesce_ms, so bouncing contacts and quick press and
+		 * release sequences result in a single event.
+		 */
+		if (bdata->report_pending) {
+			bdata->stats.coalesced++;
+		} else {
+			bdata->report_pending = true;
+			bdata->changed = seen;
+		}
+		mod_delayed_work(system_wq, &bdata->report_work,
+				 msecs_to_jiffies(coalesce_ms));
+	} else {
+		gpio_keys_report(bdata, type, state, seen);
+	}
 
 set_state:
 	bdata->last_state = state;
 	bdata->count = 0;
+out:
+	mutex_unlock(&bdata->lock);
 }
 
 struct gpio_keys_button_dev {
@@ -301,10 +540,34 @@ struct gpio_keys_button_dev {
 	struct delayed_work work;
 
 	struct device *dev;
+	struct dentry *debugfs;
 	struct gpio_keys_platform_data *pdata;
 	struct gpio_keys_button_data data[];
 };
 
+static int gpio_keys_stats_show(struct seq_file *s, void *data)
+{
+	struct gpio_keys_button_dev *bdev = s->private;
+	int i;
+
+	seq_puts(s, "button changes events coalesced presses max_hold\n");
+	for (i = 0; i < bdev->pdata->nbuttons; i++) {
+		struct gpio_keys_button_data *bdata = &bdev->data[i];
+
+		if (!bdata->gpiod)
+			continue;
+
+		seq_printf(s, "%s %lu %lu %lu %lu %lu\n",
+			   button_map[bdata->map_entry].name,
+			   bdata->stats.changes, bdata->stats.events,
+			   bdata->stats.coalesced, bdata->stats.presses,
+			   bdata->stats.max_hold);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(gpio_keys_stats);
+
 static void gpio_keys_polled_queue_work(struct gpio_keys_button_dev *bdev)
 {
 	struct gpio_keys_platform_data *pdata = bdev->pdata;
@@ -333,9 +596,13 @@ static void gpio_keys_polled_poll(struct work_struct *work)
 static void gpio_keys_polled_close(struct gpio_keys_button_dev *bdev)
 {
 	struct gpio_keys_platform_data *pdata = bdev->pdata;
+	int i;
 
 	cancel_delayed_work_sync(&bdev->work);
 
+	for (i = 0; i < pdata->nbuttons; i++)
+		cancel_delayed_work_sync(&bdev->data[i].report_work);
+
 	if (pdata->disable)
 		pdata->disable(bdev->dev);
 }
@@ -486,6 +753,11 @@ static int gpio_keys_button_probe(struct platform_device *pdev,
 		struct gpio_keys_button_data *bdata = &bdev->data[i];
 		const char *desc = button->desc ? button->desc : DRV_NAME;
 
+		mutex_init(&bdata->lock);
+		INIT_DELAYED_WORK(&bdata->report_work,
+				  gpio_keys_report_work_func);
+		bdata->reported_state = -1;
+
 		if (button->wakeup) {
 			dev_err(dev, "does not support wakeup\n");
 			error = -EINVAL;
@@ -579,6 +851,9 @@ static int gpio_keys_button_probe(struct platform_device *pdev,
 
 	bdev->dev = &pdev->dev;
 	bdev->pdata = pdata;
+	bdev->debugfs = debugfs_create_file(dev_name(dev), 0400,
+					    bh_debugfs_dir, bdev,
+					    &gpio_keys_stats_fops);
 	platform_set_drvdata(pdev, bdev);
 
 	*_bdev = bdev;
@@ -671,6 +946,7 @@ static void gpio_keys_irq_close(struct gpio_keys_button_dev *bdev)
 
 		disable_irq(bdata->irq);
 		cancel_delayed_work_sync(&bdata->work);
+		cancel_delayed_work_sync(&bdata->report_work);
 	}
 }
 
@@ -679,6 +955,7 @@ static void gpio_keys_remove(struct platform_device *pdev)
 	struct gpio_keys_button_dev *bdev = platform_get_drvdata(pdev);
 
 	platform_set_drvdata(pdev, NULL);
+	debugfs_remove(bdev->debugfs);
 
 	if (bdev->polled)
 		gpio_keys_polled_close(bdev);
@@ -708,14 +985,28 @@ static int __init gpio_button_init(void)
 {
 	int ret;
 
+	bh_debugfs_dir = debugfs_create_dir("gpio-button-hotplug", NULL);
+
+	ret = misc_register(&bh_queue_dev);
+	if (ret)
+		goto err_debugfs;
+
 	ret = platform_driver_register(&gpio_keys_driver);
 	if (ret)
-		return ret;
+		goto err_misc;
 
 	ret = platform_driver_register(&gpio_keys_polled_driver);
 	if (ret)
-		platform_driver_unregister(&gpio_keys_driver);
+		goto err_driver;
 
+	return 0;
+
+err_driver:
+	platform_driver_unregister(&gpio_keys_driver);
+err_misc:
+	misc_deregister(&bh_queue_dev);
+err_debugfs:
+	debugfs_remove_recursive(bh_debugfs_dir);
 	return ret;
 }
 
@@ -723,6 +1014,8 @@ static void __exit gpio_button_exit(void)
 {
 	platform_driver_unregister(&gpio_keys_driver);
 	platform_driver_unregister(&gpio_keys_polled_driver);
+	misc_deregister(&bh_queue_dev);
+	debugfs_remove_recursive(bh_debugfs_dir);
 }
 
 module_init(gpio_button_init);
@@ -2,116 +2,204 @@
 // Copyright (C) 2025 Felix Fietkau <nbd@nbd.name>
 'use strict';
 
-function mdns_data(model)
+const MDNS_CACHE_TIMEOUT = 5;
+const MDNS_QUERY_INTERVAL = 10;
+
+function mdns_invalidate(model, hosts_only)
 {
-	return model.ubus.call("umdns", "browse", { array: true, address: false });
+	if (!hosts_only)
+		model.cache.remove("mdns_browse");
+	model.cache.remove("mdns_hosts");
 }
 
-function refresh_timer(model)
+function mdns_subscribe(model)
 {
-	model.ubus.call("umdns", "update");
+	let mdns = model.mdns;
+	if (mdns.sub)
+		return;
 
-	model.mdns.refresh_count++;
-	if (model.mdns.refresh_count < 3)
-		model.mdns.timer.set(500);
+	mdns.sub = model.ubus.subscriber((msg) => {
+		let type_name = "" + msg.type;
+		mdns_invalidate(model, index(type_name, "host") >= 0);
+	});
+	mdns.sub.subscribe("umdns");
+}
 
-	if (model.mdns.refresh_count < 2)
-		return;
+function strip_local(name)
+{
+	if (substr(name, -6) == ".local")
+		name = substr(name, 0, -6);
+
+	return name;
+}
+
+function mdns_data(model)
+{
+	return model.cache.get("mdns_browse", () => {
+		model.mdns.browse_gen++;
+		return model.ubus.call("umdns", "browse", { array: true, address: false }) ?? {};
+	}, MDNS_CACHE_TIMEOUT);
+}
+
+function mdns_host_data(model)
+{
+	return model.cache.get("mdns_hosts", () => {
+		model.mdns.hosts_gen++;
+		return model.ubus.call("umdns", "hosts", { array: true }) ?? {};
+	}, MDNS_CACHE_TIMEOUT);
+}
+
+function index_services(idx, data)
+{
+	idx.service_names = {};
+	idx.host_services = {};
+	idx.host_servicenames = {};
 
-	let data = mdns_data(model);
 	for (let service_name, service_data in data) {
+		idx.service_names[lc(service_name)] = service_name;
 		for (let host_name, host_data in service_data) {
-			let interface = host_data.iface;
-			if (!interface)
-				continue;
-			if (host_data.host)
+			if (!host_data.host)
 				continue;
 
-			let question = host_name + "." + service_name + ".local";
-			model.ubus.call("umdns", "query", { question, interface });
+			let lc_name = lc(strip_local(host_data.host));
+			idx.host_services[lc_name] ??= {};
+			idx.host_services[lc_name][service_name] = { ...host_data, name: host_name };
+
+			let names = idx.host_servicenames[lc_name] ??= [];
+			if (index(names, host_name) < 0)
+				push(names, host_name);
 		}
 	}
 }
 
-function refresh_start(model)
+function index_hosts(idx, data)
 {
-	model.mdns.refresh_count = 0;
-	model.mdns.timer ??= model.uloop.timer(500, () => refresh_timer(model));
+	idx.hosts = {};
+	idx.host_names = {};
+
+	for (let name, val in data) {
+		name = strip_local(name);
+		idx.hosts[lc(name)] = val;
+		idx.host_names[lc(name)] = name;
+	}
 }
 
-function strip_local(name)
+// hosts <-> services <-> addresses, rebuilt only for the part that changed
+function mdns_index(model)
 {
-	if (substr(name, -6) == ".local")
-		name = substr(name, 0, -6);
+	let mdns = model.mdns;
+	let idx = mdns.index;
+	let services = mdns_data(model);
+	let hosts = mdns_host_data(model);
+
+	if (idx.browse_gen != mdns.browse_gen) {
+		index_services(idx, services);
+		idx.browse_gen = mdns.browse_gen;
+	}
 
-	return name;
+	if (idx.hosts_gen != mdns.hosts_gen) {
+		index_hosts(idx, hosts);
+		idx.hosts_gen = mdns.hosts_gen;
+	}
+
+	idx.services = services;
+	return idx;
 }
 
-function get_hosts(model)
+function pending_queries(model)
 {
-	let data = model.ubus.call("umdns", "hosts", { array: true });
-	let ret = {};
+	let queried = model.mdns.queried;
+	let now = time();
+	let ret = [];
 
-	for (let name, val in data) {
-		name = strip_local(name);
-		ret[lc(name)] = val;
+	for (let service_name, service_data in mdns_data(model)) {
+		for (let host_name, host_data in service_data) {
+			let interface = host_data.iface;
+			if (!interface)
+				continue;
+			if (host_data.host)
+				continue;
+
+			let question = host_name + "." + service_name + ".local";
+			let key = question + "%" + interface;
+			if (queried[key] && now - queried[key] < MDNS_QUERY_INTERVAL)
+				continue;
+
+			queried[key] = now;
+			push(ret, { question, interface });
+		}
 	}
 
 	return ret;
 }
 
-function get_host_names(model)
+function send_queries(model, queries)
 {
-	let data = model.ubus.call("umdns", "hosts", { array: true });
-	let ret = {};
+	let mdns = model.mdns;
 
-	for (let name, val in data) {
-		name = strip_local(name);
-		ret[lc(name)] = name;
+	// pipeline all queries instead of waiting for each reply in turn
+	for (let query in queries) {
+		mdns.pending++;
+		model.ubus.defer("umdns", "query", query, () => {
+			if (--mdns.pending > 0)
+				return;
+
+			mdns_invalidate(model);
+		});
 	}
+}
 
-	return ret;
+function refresh_timer(model)
+{
+	let mdns = model.mdns;
+
+	model.ubus.call("umdns", "update");
+
+	mdns.refresh_count++;
+	if (mdns.refresh_count < 3)
+		mdns.timer.set(500);
+
+	if (mdns.refresh_count < 2)
+		return;
+
+	mdns_invalidate(model);
+	if (!mdns.pending)
+		send_queries(model, pending_queries(model));
 }
 
-function get_host_servicenames(model)
+function refresh_start(model)
 {
-	let hosts = {};
-	let data = mdns_data(model);
-	for (let service_name, service_data in data) {
-		for (let host_name, host_data in service_data) {
-			let name = strip_local(host_data.host);
+	mdns_subscribe(model);
+	model.mdns.refresh_count = 0;
+	model.mdns.timer ??= model.uloop.timer(500, () => refresh_timer(model));
+}
 
-			hosts[lc(name)] ??= [];
-			if (index(hosts[lc(name)], host_name) < 0)
-				push(hosts[lc(name)], host_name);
-		}
-	}
-	return hosts;
+function get_hosts(model)
+{
+	return mdns_index(model).hosts;
 }
 
-function get_service_hosts(model, name)
+function get_host_names(model)
 {
-	name = lc(name);
+	return mdns_index(model).host_names;
+}
+
+function get_host_servicenames(model)
+{
+	return mdns_index(model).host_servicenames;
+}
 
-	let data = mdns_data(model);
-	for (let cur_name, hosts in data)
-		if (lc(cur_name) == name)
-			return hosts;
+function get_service_hosts(model, name)
+{
+	let idx = mdns_index(model);
+	let service_name = idx.service_names[lc(name)];
+	if (service_name != null)
+		return idx.services[service_name];
 }
 
 function get_host_services(model)
 {
-	let hosts = {};
-	let data = mdns_data(model);
-	for (let service_name, service_data in data) {
-		for (let host_name, host_data in service_data) {
-			host_data.name = host_name;
-			host_name = lc(strip_local(host_data.host));
-			hosts[host_name] ??= {};
-			hosts[host_name][service_name] = host_data;
-		}
-	}
-	return hosts;
+	return mdns_index(model).host_services;
 }
 
 function host_info(host)
@@ -264,4 +352,10 @@ const Root = {
 };
 
 model.add_nodes({ Root, MDNS });
-model.mdns = {};
+model.mdns = {
+	index: {},
+	queried: {},
+	pending: 0,
+	browse_gen: 0,
+	hosts_gen: 0,
+};
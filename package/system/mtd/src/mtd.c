@@ -24,6 +24,7 @@
 #define _GNU_SOURCE
 #include <byteswap.h>
 #include <endian.h>
+#include <getopt.h>
 #include <limits.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -53,6 +54,11 @@
 #define MAX_ARGS 8
 #define JFFS2_DEFAULT_DIR	"" /* directory name without /, empty means root dir */
 
+/* buffer size for reads and writes not bound to a single erase block */
+#define IO_CHUNK_SIZE		(1024 * 1024)
+/* pipe buffer size requested for image data from stdin */
+#define IO_PIPE_SIZE		(1024 * 1024)
+
 #define TRX_MAGIC		0x48445230	/* "HDR0" */
 #define SEAMA_MAGIC		0x5ea3a417
 #define WRG_MAGIC		0x20040220
@@ -82,6 +88,28 @@ enum mtd_image_format {
 	MTD_IMAGE_FORMAT_WRGG03,
 };
 
+enum io_phase {
+	IO_READ,
+	IO_ERASE,
+	IO_WRITE,
+	IO_FLASH_READ,
+	IO_OUTPUT,
+	__IO_MAX
+};
+
+static struct io_stats {
+	const char *name;
+	uint64_t bytes;
+	unsigned int calls;
+	double time;
+} io_stats[__IO_MAX] = {
+	[IO_READ] = { "read image" },
+	[IO_ERASE] = { "erase" },
+	[IO_WRITE] = { "write flash" },
+	[IO_FLASH_READ] = { "read flash" },
+	[IO_OUTPUT] = { "write output" },
+};
+
 static char *buf = NULL;
 static char *imagefile = NULL;
 static enum mtd_image_format imageformat = MTD_IMAGE_FORMAT_UNKNOWN;
@@ -95,6 +123,120 @@ int erasesize = 0;
 int jffs2_skip_bytes=0;
 int mtdtype = 0;
 uint32_t opt_trxmagic = TRX_MAGIC;
+static int opt_io_stats;
+
+static double io_time(void)
+{
+	struct timespec ts;
+
+	if (!opt_io_stats)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void io_account(enum io_phase phase, ssize_t len, double start)
+{
+	struct io_stats *st = &io_stats[phase];
+
+	st->calls++;
+	if (len > 0)
+		st->bytes += len;
+	st->time += io_time() - start;
+}
+
+static ssize_t io_read(enum io_phase phase, int fd, void *data, size_t len)
+{
+	double start = io_time();
+	ssize_t ret = read(fd, data, len);
+
+	io_account(phase, ret, start);
+	return ret;
+}
+
+static ssize_t io_write(enum io_phase phase, int fd, const void *data, size_t len)
+{
+	double start = io_time();
+	ssize_t ret = write(fd, data, len);
+
+	io_account(phase, ret, start);
+	return ret;
+}
+
+/* write all of data, for pipes which accept less than requested */
+static int io_write_all(enum io_phase phase, int fd, const char *data, size_t len)
+{
+	while (len > 0) {
+		ssize_t r = io_write(phase, fd, data, len);
+
+		if (r < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return -1;
+		}
+		data += r;
+		len -= r;
+	}
+
+	return 0;
+}
+
+static void *io_alloc(size_t len)
+{
+	void *ptr;
+
+	if (posix_memalign(&ptr, sysconf(_SC_PAGESIZE), len))
+		return NULL;
+
+	return ptr;
+}
+
+/* erase block multiple of up to IO_CHUNK_SIZE */
+static int io_chunk_size(void)
+{
+	if (erasesize <= 0 || erasesize >= IO_CHUNK_SIZE)
+		return erasesize;
+
+	return IO_CHUNK_SIZE / erasesize * erasesize;
+}
+
+/*
+ * Image data usually comes through a pipe from wget or zcat, which only
+ * holds 64k by default and so hands over less than an erase block per
+ * read() on many flash chips. A larger pipe lets the writer run ahead
+ * while a block is erased or written.
+ */
+static void io_setup_input(int fd)
+{
+	struct stat st;
+
+	if (fstat(fd, &st))
+		return;
+
+	if (S_ISFIFO(st.st_mode))
+		fcntl(fd, F_SETPIPE_SZ, IO_PIPE_SIZE);
+	else if (S_ISREG(st.st_mode))
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+static void io_stats_print(void)
+{
+	int i;
+
+	fprintf(stderr, "%-12s %12s %10s %10s %10s\n",
+		"phase", "bytes", "syscalls", "time(s)", "MB/s");
+	for (i = 0; i < __IO_MAX; i++) {
+		struct io_stats *st = &io_stats[i];
+
+		if (!st->calls)
+			continue;
+
+		fprintf(stderr, "%-12s %12llu %10u %10.3f %10.2f\n",
+			st->name, (unsigned long long)st->bytes, st->calls, st->time,
+			st->time > 0 ? st->bytes / st->time / 1e6 : 0);
+	}
+}
 
 int mtd_open(const char *mtd, bool block)
 {
@@ -167,11 +309,15 @@ int mtd_block_is_bad(int fd, int offset)
 int mtd_erase_block(int fd, int offset)
 {
 	struct erase_info_user mtdEraseInfo;
+	double start = io_time();
+	int ret;
 
 	mtdEraseInfo.start = offset;
 	mtdEraseInfo.length = erasesize;
 	ioctl(fd, MEMUNLOCK, &mtdEraseInfo);
-	if (ioctl (fd, MEMERASE, &mtdEraseInfo) < 0)
+	ret = ioctl(fd, MEMERASE, &mtdEraseInfo);
+	io_account(IO_ERASE, ret < 0 ? -1 : erasesize, start);
+	if (ret < 0)
 		return -1;
 
 	return 0;
@@ -192,7 +338,7 @@ image_check(int imagefd, const char *mtd)
 	int bufread;
 
 	while (buflen < sizeof(magic)) {
-		bufread = read(imagefd, buf + buflen, sizeof(magic) - buflen);
+		bufread = io_read(IO_READ, imagefd, buf + buflen, sizeof(magic) - buflen);
 		if (bufread < 1)
 			break;
 
@@ -258,7 +404,7 @@ static int mtd_check(const char *mtd)
 			return 0;
 
 		if (!buf)
-			buf = malloc(erasesize);
+			buf = io_alloc(erasesize);
 
 		close(fd);
 		mtd = next;
@@ -351,7 +497,7 @@ static int
 mtd_dump(const char *mtd, int part_offset, int size)
 {
 	int ret = 0, offset = 0;
-	int fd;
+	int fd, chunk;
 	char *buf;
 
 	if (quiet < 2)
@@ -369,13 +515,16 @@ mtd_dump(const char *mtd, int part_offset, int size)
 	if (part_offset)
 		lseek(fd, part_offset, SEEK_SET);
 
-	buf = malloc(erasesize);
+	chunk = io_chunk_size();
+	buf = io_alloc(chunk);
 	if (!buf)
 		return -1;
 
+	/* read several erase blocks at once, skip bad ones when writing them out */
 	do {
-		int len = (size > erasesize) ? (erasesize) : (size);
-		int rlen = read(fd, buf, len);
+		int len = (size > chunk) ? (chunk) : (size);
+		int rlen = io_read(IO_FLASH_READ, fd, buf, len);
+		int pos = 0, out = 0;
 
 		if (rlen < 0) {
 			if (errno == EINTR)
@@ -383,18 +532,35 @@ mtd_dump(const char *mtd, int part_offset, int size)
 			ret = -1;
 			goto out;
 		}
-		if (!rlen || rlen != len)
+		if (!rlen)
 			break;
-		if (mtd_block_is_bad(fd, offset)) {
-			fprintf(stderr, "skipping bad block at 0x%08x\n", offset);
-		} else {
-			size -= rlen;
-			write(1, buf, rlen);
+
+		while (pos < rlen) {
+			int blen = MIN(erasesize, rlen - pos);
+
+			if (mtd_block_is_bad(fd, offset + pos)) {
+				fprintf(stderr, "skipping bad block at 0x%08x\n", offset + pos);
+				if (io_write_all(IO_OUTPUT, 1, buf + out, pos - out) < 0) {
+					ret = -1;
+					goto out;
+				}
+				out = pos + blen;
+			} else {
+				size -= blen;
+			}
+			pos += blen;
+		}
+		if (io_write_all(IO_OUTPUT, 1, buf + out, rlen - out) < 0) {
+			ret = -1;
+			goto out;
 		}
 		offset += rlen;
+		if (rlen != len)
+			break;
 	} while (size > 0);
 
 out:
+	free(buf);
 	close(fd);
 	return ret;
 }
@@ -406,7 +572,8 @@ mtd_verify(const char *mtd, char *file)
 	struct stat s;
 	md5_ctx_t ctx;
 	int ret = 0;
-	int fd;
+	int fd, chunk;
+	char *buf;
 
 	if (quiet < 2)
 		fprintf(stderr, "Verifying %s against %s ...\n", mtd, file);
@@ -422,11 +589,17 @@ mtd_verify(const char *mtd, char *file)
 		return -1;
 	}
 
+	chunk = io_chunk_size();
+	buf = io_alloc(chunk);
+	if (!buf) {
+		close(fd);
+		return -1;
+	}
+
 	md5_begin(&ctx);
 	do {
-		char buf[256];
-		int len = (s.st_size > sizeof(buf)) ? (sizeof(buf)) : (s.st_size);
-		int rlen = read(fd, buf, len);
+		int len = (s.st_size > chunk) ? (chunk) : (s.st_size);
+		int rlen = io_read(IO_FLASH_READ, fd, buf, len);
 
 		if (rlen < 0) {
 			if (errno == EINTR)
@@ -452,6 +625,7 @@ mtd_verify(const char *mtd, char *file)
 		fprintf(stderr, "Failed\n");
 
 out:
+	free(buf);
 	close(fd);
 	return ret;
 }
@@ -578,7 +752,7 @@ resume:
 	for (;;) {
 		/* buffer may contain data already (from trx check or last mtd partition write attempt) */
 		while (buflen < erasesize) {
-			r = read(imagefd, buf + buflen, erasesize - buflen);
+			r = io_read(IO_READ, imagefd, buf + buflen, erasesize - buflen);
 			if (r < 0) {
 				if ((errno == EINTR) || (errno == EAGAIN))
 					continue;
@@ -687,7 +861,7 @@ resume:
 		if (!quiet)
 			fprintf(stderr, "\b\b\b[w]");
 
-		if ((result = write(fd, buf + offset, buflen)) < buflen) {
+		if ((result = io_write(IO_WRITE, fd, buf + offset, buflen)) < buflen) {
 			if (result < 0) {
 				fprintf(stderr, "Error writing image.\n");
 				exit(1);
@@ -808,7 +982,8 @@ static void usage(void)
 	"        -j <name>               integrate <file> into jffs2 data when writing an image\n"
 	"        -s <number>             skip the first n bytes when appending data to the jffs2 partiton, defaults to \"0\"\n"
 	"        -p <number>             write beginning at partition offset\n"
-	"        -l <length>             the length of data that we want to dump\n");
+	"        -l <length>             the length of data that we want to dump\n"
+	"        -S, --io-stats          print bytes, syscalls and throughput of each I/O phase\n");
 	if (mtd_fixtrx) {
 	    fprintf(stderr,
 	"        -M <magic>              magic number of the image header in the partition (for fixtrx)\n"
@@ -848,6 +1023,11 @@ static void do_reboot(void)
 	syscall(SYS_reboot,LINUX_REBOOT_MAGIC1,LINUX_REBOOT_MAGIC2,LINUX_REBOOT_CMD_RESTART,NULL);
 }
 
+static const struct option long_options[] = {
+	{ "io-stats", no_argument, NULL, 'S' },
+	{ NULL, 0, NULL, 0 }
+};
+
 int main (int argc, char **argv)
 {
 	int ch, i, boot, imagefd = 0, force, unlocked;
@@ -875,11 +1055,11 @@ int main (int argc, char **argv)
 	quiet = 0;
 	no_erase = 0;
 
-	while ((ch = getopt(argc, argv,
+	while ((ch = getopt_long(argc, argv,
 #ifdef FIS_SUPPORT
 			"F:"
 #endif
-			"frnqe:d:s:j:p:o:c:t:l:M:")) != -1)
+			"frnqSe:d:s:j:p:o:c:t:l:M:", long_options, NULL)) != -1)
 		switch (ch) {
 			case 'f':
 				force = 1;
@@ -904,6 +1084,9 @@ int main (int argc, char **argv)
 			case 'q':
 				quiet++;
 				break;
+			case 'S':
+				opt_io_stats = 1;
+				break;
 			case 'e':
 				i = 0;
 				while ((erase[i] != NULL) && ((i + 1) < MAX_ARGS))
@@ -1016,6 +1199,8 @@ int main (int argc, char **argv)
 			}
 		}
 
+		io_setup_input(imagefd);
+
 		if (!mtd_check(device)) {
 			fprintf(stderr, "Can't open device for writing!\n");
 			exit(1);
@@ -1102,6 +1287,9 @@ int main (int argc, char **argv)
 
 	sync();
 
+	if (opt_io_stats)
+		io_stats_print();
+
 	if (boot)
 		do_reboot();
 
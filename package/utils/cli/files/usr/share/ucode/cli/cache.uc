@@ -2,15 +2,117 @@
 // Copyright (C) 2025 Felix Fietkau <nbd@nbd.name>
 'use strict';
 
+// timeouts are in seconds and may be fractional (millisecond resolution)
 const CACHE_DEFAULT_TIMEOUT = 5;
+const CACHE_DEFAULT_STALE = 30;
+const CACHE_DEFAULT_SIZE = 256;
+const CACHE_GC_INTERVAL = 10000;
 
-function cache_get(key, fn, timeout)
+function now_ms()
 {
-	let now = time();
+	let ts = clock(true);
+	return ts[0] * 1000 + ts[1] / 1000000;
+}
+
+function cache_opts(opts)
+{
+	if (type(opts) == "object")
+		return opts;
+
+	return { timeout: opts };
+}
+
+function cache_evict(size)
+{
+	while (length(this.entries) > size) {
+		let lru_key, lru;
+		for (let key, entry in this.entries) {
+			if (entry.refreshing)
+				continue;
+			if (!lru || entry.used < lru.used) {
+				lru_key = key;
+				lru = entry;
+			}
+		}
+
+		if (!lru)
+			break;
+
+		delete this.entries[lru_key];
+		this.stats.evictions++;
+	}
+}
+
+function cache_fill(key, entry, fn, opts)
+{
+	let start = now_ms();
+	let data;
+
+	entry.refreshing = true;
+	try {
+		data = fn();
+	} catch (e) {
+		entry.refreshing = false;
+		this.stats.errors++;
+		if (!entry.valid)
+			delete this.entries[key];
+		die(e.message);
+	}
+
+	let now = now_ms();
+	let timeout = opts.timeout ?? CACHE_DEFAULT_TIMEOUT;
+	let stale = opts.stale ?? CACHE_DEFAULT_STALE;
+	entry.refreshing = false;
+	entry.valid = true;
+	entry.data = data;
+	entry.timeout = now + timeout * 1000;
+	entry.stale = entry.timeout + stale * 1000;
+	entry.used = now;
+	this.stats.fill_time += now - start;
+
+	return data;
+}
+
+function cache_refresh(key, entry, fn, opts)
+{
+	if (entry.refreshing)
+		return;
+
+	let cache = this;
+	entry.refreshing = true;
+	this.stats.refreshes++;
+	this.model.uloop.timer(0, () => {
+		entry.refreshing = false;
+		if (cache.entries[key] != entry)
+			return;
+
+		try {
+			call(cache_fill, cache, null, key, entry, fn, opts);
+		} catch (e) {
+			cache.model.exception(e);
+		}
+	});
+}
+
+function cache_get(key, fn, opts)
+{
+	let now = now_ms();
 	let entry = this.entries[key];
-	if (entry) {
-		if (now < entry.timeout)
+
+	opts = cache_opts(opts);
+	if (entry && entry.valid) {
+		if (now < entry.timeout) {
+			entry.used = now;
+			this.stats.hits++;
+			return entry.data;
+		}
+
+		if (fn && now < entry.stale) {
+			entry.used = now;
+			this.stats.stale_hits++;
+			call(cache_refresh, this, null, key, entry, fn, opts);
 			return entry.data;
+		}
 
 		if (!fn)
 			delete this.entries[key];
@@ -19,14 +121,18 @@ function cache_get(key, fn, timeout)
 	if (!fn)
 		return;
 
-	let data = fn();
-	if (!entry)
-		this.entries[key] = entry = {};
-	timeout ??= CACHE_DEFAULT_TIMEOUT;
-	entry.timeout = now + timeout;
-	entry.data = data;
+	// single-flight: a nested lookup while the entry is being filled
+	// must not trigger the same expensive call again
+	if (entry && entry.refreshing)
+		return entry.data;
 
-	return data;
+	this.stats.misses++;
+	if (!entry) {
+		call(cache_evict, this, null, this.max_size - 1);
+		this.entries[key] = entry = { used: now };
+	}
+
+	return call(cache_fill, this, null, key, entry, fn, opts);
 }
 
 function cache_remove(key)
@@ -34,25 +140,56 @@ function cache_remove(key)
 	delete this.entries[key];
 }
 
+function cache_flush()
+{
+	this.entries = {};
+}
+
 function cache_gc() {
-	let now = time();
+	let now = now_ms();
 	for (let key, entry in this.entries)
-		if (now > entry.timeout)
+		if (!entry.refreshing && now > entry.stale)
 			delete this.entries[key];
 }
 
+function cache_status()
+{
+	let stats = this.stats;
+	let lookups = stats.hits + stats.stale_hits + stats.misses;
+
+	return {
+		...stats,
+		entries: length(this.entries),
+		max_size: this.max_size,
+		hit_rate: lookups ? sprintf("%.1f%%", (stats.hits + stats.stale_hits) * 100 / lookups) : "-",
+		fill_time: sprintf("%.1f ms", stats.fill_time),
+	};
+}
+
 const cache_proto = {
 	get: cache_get,
 	remove: cache_remove,
+	flush: cache_flush,
 	gc: cache_gc,
+	status: cache_status,
 };
 
-export function new(model) {
+export function new(model, size) {
 	model.cache_proto ??= { model, ...cache_proto };
 	let cache = proto({
 		entries: {},
+		max_size: size ?? CACHE_DEFAULT_SIZE,
+		stats: {
+			hits: 0,
+			stale_hits: 0,
+			misses: 0,
+			refreshes: 0,
+			evictions: 0,
+			errors: 0,
+			fill_time: 0,
+		},
 	}, model.cache_proto);
-	cache.gc_interval = model.uloop.interval(10000, () => {
+	cache.gc_interval = model.uloop.interval(CACHE_GC_INTERVAL, () => {
 		cache.gc();
 	});
 
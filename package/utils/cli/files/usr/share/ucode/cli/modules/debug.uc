@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Felix Fietkau <nbd@nbd.name>
+'use strict';
+
+const Debug = {
+	cache: {
+		help: "Show cache statistics",
+		call: function(ctx, argv) {
+			return ctx.table("Cache", model.cache.status());
+		}
+	},
+	"cache-flush": {
+		help: "Flush all cached data",
+		call: function(ctx, argv) {
+			model.cache.flush();
+			return ctx.ok("Cache flushed");
+		}
+	},
+};
+
+const Root = {
+	debug: {
+		help: "CLI debugging tools",
+		select_node: "Debug",
+	}
+};
+
+model.add_nodes({ Root, Debug });
@@ -411,6 +411,18 @@ ifeq ($(CONFIG_BUILD_LOG),y)
   BUILD_LOG:=1
 endif
 
+ifeq ($(CONFIG_BUILD_PROFILE),y)
+  export BUILD_PROFILE_LOG:=$(BUILD_LOG_DIR)/profile.log
+endif
+
+##@
+# @brief Record the start or end of a build phase in the build profile.
+#
+# @param 1: Phase name.
+# @param 2: start or end.
+##
+profile_phase = $(if $(BUILD_PROFILE_LOG),@$(SCRIPT_DIR)/time.pl --mark "$(or $(BUILD_SUBDIR),$(CURDIR))" $(1) $(2))
+
 export BISON_PKGDATADIR:=$(STAGING_DIR_HOST)/share/bison
 export HOST_GNULIB_SRCDIR:=$(STAGING_DIR_HOST)/share/gnulib
 export M4:=$(STAGING_DIR_HOST)/bin/m4
@@ -0,0 +1,142 @@
+#!/usr/bin/env perl
+#
+# Copyright (C) 2025 OpenWrt.org
+#
+# This is free software, licensed under the GNU General Public License v2.
+# See /LICENSE for more information.
+#
+# Summarize the build profile written with CONFIG_BUILD_PROFILE enabled
+# (see scripts/time.pl): overall parallelism, the chain of steps which
+# determined the total build time and the steps using the most time,
+# CPU and memory.
+
+use strict;
+use warnings;
+use Getopt::Long;
+use JSON::PP;
+
+my $top = 15;
+my $help;
+
+GetOptions('top|n=i' => \$top, 'help|h' => \$help) && !$help && @ARGV <= 1
+	or die "Usage: $0 [-n <count>] [<logs/profile.log>]\n";
+
+my $log = $ARGV[0] // ($ENV{BUILD_LOG_DIR} // 'logs') . '/profile.log';
+my $json = JSON::PP->new;
+my (@steps, %phase_start, %phases);
+
+open my $fh, '<', $log or die "Cannot open $log: $!\n";
+while (my $line = <$fh>) {
+	my $rec = eval { $json->decode($line) } or next;
+
+	if (defined $rec->{event}) {
+		my $key = "$rec->{step}\t$rec->{phase}";
+
+		if ($rec->{event} eq 'start') {
+			$phase_start{$key} = $rec->{time};
+		} elsif (defined $phase_start{$key}) {
+			$phases{$rec->{step}}{$rec->{phase}} += $rec->{time} - delete $phase_start{$key};
+		}
+		next;
+	}
+
+	$rec->{wall} = $rec->{end} - $rec->{start};
+	$rec->{cpu} = $rec->{user} + $rec->{sys};
+	push @steps, $rec;
+}
+close $fh;
+
+@steps or die "No build steps recorded in $log\n";
+
+sub fmt_time($) {
+	my $t = shift;
+
+	return sprintf("%dh%02dm%02ds", $t / 3600, ($t / 60) % 60, $t % 60) if $t >= 3600;
+	return sprintf("%dm%02ds", $t / 60, $t % 60) if $t >= 60;
+	return sprintf("%.1fs", $t);
+}
+
+sub fmt_rss($) {
+	my $kb = shift;
+
+	return '-' unless defined $kb;
+	return sprintf("%.1fG", $kb / 1048576) if $kb >= 1048576;
+	return sprintf("%.0fM", $kb / 1024);
+}
+
+# package/libs/foo/compile -> package/libs/foo, for the phase marks
+sub step_dir($) {
+	my $step = shift;
+
+	$step =~ s!/(?:host-)?[^/]+$!!;
+	return $step;
+}
+
+sub fmt_phases($) {
+	my $p = $phases{step_dir(shift)} or return '';
+
+	return join(' ', map { "$_ " . fmt_time($p->{$_}) }
+		sort { $p->{$b} <=> $p->{$a} } keys %$p);
+}
+
+sub print_steps($@) {
+	my ($title, @list) = @_;
+
+	print "\n$title:\n";
+	printf "  %-48s %9s %9s %6s %7s %6s  %s\n",
+		'step', 'wall', 'cpu', 'cores', 'rss', 'cache', 'phases';
+	foreach my $s (@list[0 .. ($top < @list ? $top : @list) - 1]) {
+		my $cc = $s->{ccache_hit} + $s->{ccache_miss};
+
+		printf "  %-48s %9s %9s %6.2f %7s %6s  %s\n",
+			$s->{step}, fmt_time($s->{wall}), fmt_time($s->{cpu}),
+			$s->{cores}, fmt_rss($s->{maxrss}),
+			$cc ? sprintf("%.0f%%", $s->{ccache_hit} * 100 / $cc) : '-',
+			fmt_phases($s->{step});
+	}
+}
+
+my ($first, $last, $cpu, $hits, $misses, $failed) = (undef, 0, 0, 0, 0, 0);
+foreach my $s (@steps) {
+	$first = $s->{start} if !defined($first) || $s->{start} < $first;
+	$last = $s->{end} if $s->{end} > $last;
+	$cpu += $s->{cpu};
+	$hits += $s->{ccache_hit};
+	$misses += $s->{ccache_miss};
+	$failed++ if $s->{status};
+}
+
+my $span = $last - $first;
+printf "%d steps%s, %s elapsed, %s CPU, average parallelism %.2f\n",
+	scalar(@steps), $failed ? " ($failed failed)" : '',
+	fmt_time($span), fmt_time($cpu), $span > 0 ? $cpu / $span : 0;
+printf "ccache: %d hits, %d misses (%.1f%%)\n", $hits, $misses,
+	$hits * 100 / ($hits + $misses) if $hits + $misses;
+
+# Walk back from the step which finished last: the step blocking a step is
+# the one which finished last before it started. This follows the chain
+# of steps which could not overlap and so determined the total build time.
+my @by_end = sort { $a->{end} <=> $b->{end} } @steps;
+my @path = ($by_end[-1]);
+for (my $i = $#by_end - 1; $i >= 0; $i--) {
+	next if $by_end[$i]{end} > $path[-1]{start} + 0.01;
+	push @path, $by_end[$i];
+}
+
+my $path_time = 0;
+$path_time += $_->{wall} for @path;
+printf "\nCritical path: %d steps, %s of %s elapsed:\n", scalar(@path),
+	fmt_time($path_time), fmt_time($span);
+foreach my $s (reverse @path) {
+	printf "  %9s  +%-9s %s\n", fmt_time($s->{end} - $first),
+		fmt_time($s->{wall}), $s->{step};
+}
+
+print_steps('Longest steps', sort { $b->{wall} <=> $a->{wall} } @steps);
+print_steps('Most CPU time', sort { $b->{cpu} <=> $a->{cpu} } @steps);
+print_steps('Highest peak memory', sort { ($b->{maxrss} // 0) <=> ($a->{maxrss} // 0) } @steps);
+
+# long steps which barely use more than one core hold back parallel builds
+my @serial = sort { $b->{wall} <=> $a->{wall} }
+	grep { $_->{wall} >= 30 && $_->{cores} < 1.5 } @steps;
+print_steps('Long mostly serial steps', @serial) if @serial;
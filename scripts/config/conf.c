@@ -46,6 +46,11 @@ static int sync_kconfig;
 static int conf_cnt;
 static char line[PATH_MAX];
 static struct menu *rootEntry;
+static int benchmark;
+static struct timespec bench_last;
+
+/* number of symbols flipped by the benchmark after writing the config */
+#define BENCH_TOGGLE_MAX	500
 
 static void print_help(struct menu *menu)
 {
@@ -665,9 +670,77 @@ static void check_conf(struct menu *menu)
 		check_conf(child);
 }
 
+static void bench_step(const char *name, int count)
+{
+	struct timespec now;
+
+	if (!benchmark)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (name)
+		fprintf(stderr, "benchmark: %-8s %10.3f ms (%d)\n", name,
+			(now.tv_sec - bench_last.tv_sec) * 1e3 +
+			(now.tv_nsec - bench_last.tv_nsec) / 1e6, count);
+	bench_last = now;
+}
+
+static unsigned int bench_calc_all(unsigned int hash)
+{
+	struct symbol *sym;
+	const char *val;
+	int i;
+
+	for_all_symbols(i, sym) {
+		sym_calc_value(sym);
+		if (!sym->name)
+			continue;
+		for (val = sym_get_string_value(sym); *val; val++)
+			hash = hash * 31 + *val;
+	}
+
+	return hash;
+}
+
+/*
+ * Flip changeable bool/tristate symbols one at a time and recalculate all
+ * symbols after every change, as a frontend does after user input. The
+ * printed hash of all values allows comparing the results of two builds.
+ */
+static void bench_toggle(void)
+{
+	struct symbol *sym;
+	unsigned int hash = 0;
+	tristate oldval;
+	int i, count = 0;
+
+	for_all_symbols(i, sym) {
+		if (count == BENCH_TOGGLE_MAX)
+			break;
+		if (!sym->name || sym_is_choice_value(sym) ||
+		    !sym_is_changeable(sym))
+			continue;
+		if (sym_get_type(sym) != S_BOOLEAN &&
+		    sym_get_type(sym) != S_TRISTATE)
+			continue;
+
+		oldval = sym_get_tristate_value(sym);
+		sym_toggle_tristate_value(sym);
+		hash = bench_calc_all(hash);
+		sym_set_tristate_value(sym, oldval);
+		hash = bench_calc_all(hash);
+		count++;
+	}
+
+	bench_step("toggle", count);
+	if (benchmark)
+		fprintf(stderr, "benchmark: values hash %08x\n", hash);
+}
+
 static const struct option long_opts[] = {
 	{"help",          no_argument,       NULL,            'h'},
 	{"silent",        no_argument,       NULL,            's'},
+	{"benchmark",     no_argument,       NULL,            'b'},
 	{"oldaskconfig",  no_argument,       &input_mode_opt, oldaskconfig},
 	{"oldconfig",     no_argument,       &input_mode_opt, oldconfig},
 	{"syncconfig",    no_argument,       &input_mode_opt, syncconfig},
@@ -698,6 +771,7 @@ static void conf_usage(const char *progname)
 	printf("  -s, --silent            Do not print log.\n");
 	printf("  -w <file>               Write config to <file>.\n");
 	printf("  --fatalrecursive        Treat recursive dependency as error.\n");
+	printf("  -b, --benchmark         Print the time taken by each step to stderr.\n");
 	printf("\n");
 	printf("Mode options:\n");
 	printf("  --listnewconfig         List new options\n");
@@ -730,8 +804,11 @@ int main(int ac, char **av)
 
 	tty_stdio = isatty(0) && isatty(1);
 
-	while ((opt = getopt_long(ac, av, "hr:w:s", long_opts, NULL)) != -1) {
+	while ((opt = getopt_long(ac, av, "bhr:w:s", long_opts, NULL)) != -1) {
 		switch (opt) {
+		case 'b':
+			benchmark = 1;
+			break;
 		case 'h':
 			conf_usage(progname);
 			exit(1);
@@ -779,8 +856,17 @@ int main(int ac, char **av)
 		conf_usage(progname);
 		exit(1);
 	}
+	bench_step(NULL, 0);
 	conf_parse(av[optind]);
 	//zconfdump(stdout);
+	if (benchmark) {
+		struct symbol *sym;
+		int i, count = 0;
+
+		for_all_symbols(i, sym)
+			count++;
+		bench_step("parse", count);
+	}
 
 	switch (input_mode) {
 	case defconfig:
@@ -813,6 +899,7 @@ int main(int ac, char **av)
 	default:
 		break;
 	}
+	bench_step("read", 0);
 
 	if (sync_kconfig) {
 		name = getenv("KCONFIG_NOSILENTUPDATE");
@@ -876,6 +963,7 @@ int main(int ac, char **av)
 	default:
 		break;
 	}
+	bench_step("process", 0);
 
 	if (input_mode == savedefconfig) {
 		if (conf_write_defconfig(defconfig_file)) {
@@ -905,5 +993,10 @@ int main(int ac, char **av)
 			return 1;
 		}
 	}
+	bench_step("write", 0);
+
+	if (benchmark)
+		bench_toggle();
+
 	return 0;
 }
@@ -129,6 +129,13 @@ struct symbol {
 	 * "Weak" reverse dependencies through being implied by other symbols
 	 */
 	struct expr_value implied;
+
+	/*
+	 * Symbols whose value or visibility is calculated from this symbol.
+	 * Built on the first value change, see sym_invalidate().
+	 */
+	struct symbol **dependents;
+	int dependents_cnt, dependents_size;
 };
 
 #define for_all_symbols(i, sym) for (i = 0; i < SYMBOL_HASHSIZE; i++) for (sym = symbol_hash[i]; sym; sym = sym->next)
@@ -156,6 +163,9 @@ struct symbol {
 /* choice values need to be set before calculating this symbol value */
 #define SYMBOL_NEED_SET_CHOICE_VALUES  0x100000
 
+/* visited while invalidating the dependents of a changed symbol */
+#define SYMBOL_INVALIDATED  0x200000
+
 #define SYMBOL_MAXLENGTH	256
 #define SYMBOL_HASHSIZE		9973
 
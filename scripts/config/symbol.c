@@ -443,6 +443,135 @@ void sym_calc_value(struct symbol *sym)
 		set_all_choice_values(sym);
 }
 
+static void sym_add_dependent(struct symbol *sym, struct symbol *dep)
+{
+	if (!sym || sym == dep || sym->flags & SYMBOL_CONST)
+		return;
+
+	/* all references of a symbol are added in one go */
+	if (sym->dependents_cnt && sym->dependents[sym->dependents_cnt - 1] == dep)
+		return;
+
+	if (sym->dependents_cnt == sym->dependents_size) {
+		sym->dependents_size = sym->dependents_size ? sym->dependents_size * 2 : 4;
+		sym->dependents = xrealloc(sym->dependents,
+					   sym->dependents_size * sizeof(*sym->dependents));
+	}
+	sym->dependents[sym->dependents_cnt++] = dep;
+}
+
+static void expr_add_dependent(struct expr *e, struct symbol *dep)
+{
+	if (!e)
+		return;
+
+	switch (e->type) {
+	case E_SYMBOL:
+		sym_add_dependent(e->left.sym, dep);
+		break;
+	case E_NOT:
+		expr_add_dependent(e->left.expr, dep);
+		break;
+	case E_OR:
+	case E_AND:
+		expr_add_dependent(e->left.expr, dep);
+		expr_add_dependent(e->right.expr, dep);
+		break;
+	case E_LIST:
+		expr_add_dependent(e->left.expr, dep);
+		sym_add_dependent(e->right.sym, dep);
+		break;
+	case E_EQUAL:
+	case E_UNEQUAL:
+	case E_LTH:
+	case E_LEQ:
+	case E_GTH:
+	case E_GEQ:
+	case E_RANGE:
+		sym_add_dependent(e->left.sym, dep);
+		sym_add_dependent(e->right.sym, dep);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Record for every symbol which other symbols read it while calculating
+ * their value: everything referenced from their properties (prompts,
+ * defaults, ranges, choice values and the choice itself) and their
+ * direct, reverse and implied dependencies. Select and imply properties
+ * are only evaluated through the target's reverse dependencies.
+ */
+static void sym_build_dependents(void)
+{
+	struct symbol *sym;
+	struct property *prop;
+	int i;
+
+	for_all_symbols(i, sym) {
+		for (prop = sym->prop; prop; prop = prop->next) {
+			/* these are evaluated as part of the target's rev_dep/implied */
+			if (prop->type == P_SELECT || prop->type == P_IMPLY)
+				continue;
+			expr_add_dependent(prop->expr, sym);
+			expr_add_dependent(prop->visible.expr, sym);
+		}
+		expr_add_dependent(sym->dir_dep.expr, sym);
+		expr_add_dependent(sym->rev_dep.expr, sym);
+		expr_add_dependent(sym->implied.expr, sym);
+	}
+}
+
+/*
+ * Invalidate the value of sym and of everything calculated from it,
+ * instead of recalculating all symbols after a single change.
+ */
+static void sym_invalidate(struct symbol *sym)
+{
+	static bool dependents_built;
+	struct symbol **queue;
+	int i, head = 0, n = 0, size = 64;
+
+	if (sym == modules_sym) {
+		sym_clear_all_valid();
+		return;
+	}
+
+	if (!dependents_built) {
+		sym_build_dependents();
+		dependents_built = true;
+	}
+
+	queue = xmalloc(size * sizeof(*queue));
+	sym->flags |= SYMBOL_INVALIDATED;
+	queue[n++] = sym;
+	while (head < n) {
+		sym = queue[head++];
+		sym->flags &= ~SYMBOL_VALID;
+		for (i = 0; i < sym->dependents_cnt; i++) {
+			struct symbol *dep = sym->dependents[i];
+
+			if (dep->flags & SYMBOL_INVALIDATED)
+				continue;
+
+			dep->flags |= SYMBOL_INVALIDATED;
+			if (n == size) {
+				size *= 2;
+				queue = xrealloc(queue, size * sizeof(*queue));
+			}
+			queue[n++] = dep;
+		}
+	}
+
+	for (i = 0; i < n; i++)
+		queue[i]->flags &= ~SYMBOL_INVALIDATED;
+	free(queue);
+
+	conf_set_changed(true);
+	sym_calc_value(modules_sym);
+}
+
 void sym_clear_all_valid(void)
 {
 	struct symbol *sym;
@@ -504,7 +633,7 @@ bool sym_set_tristate_value(struct symbol *sym, tristate val)
 
 	sym->def[S_DEF_USER].tri = val;
 	if (oldval != val)
-		sym_clear_all_valid();
+		sym_invalidate(sym);
 
 	return true;
 }
@@ -661,7 +790,7 @@ bool sym_set_string_value(struct symbol *sym, const char *newval)
 
 	strcpy(val, newval);
 	free((void *)oldval);
-	sym_clear_all_valid();
+	sym_invalidate(sym);
 
 	return true;
 }
@@ -14,9 +14,16 @@ import os
 import re
 import getopt
 import shutil
+import fnmatch
+import glob
+import hashlib
+import tempfile
+import concurrent.futures
 
 # Commandline options
 opt_dryrun = False
+opt_verify = False
+opt_jobs = os.cpu_count() or 1
 
 
 def parseVer_1234(match, filepath):
@@ -204,6 +211,576 @@ class Entry:
         return self.version >= y.version
 
 
+# Garbage collection mode: instead of guessing stale versions from the file
+# names, build an index of the source files referenced by one or more trees
+# and delete everything else.
+#
+# The index is built from the Makefiles directly, with a small make variable
+# expander. Variables assigned in conditional blocks keep all alternatives,
+# and references which cannot be expanded (config symbols, variables set
+# outside of the Makefile, make functions) become wildcards, so that a file
+# which might be needed is always kept.
+
+MAX_ALTERNATIVES = 32
+
+gcScanDirs = ("tools", "toolchain", "package", "target", "feeds")
+
+makeAssign = re.compile(
+    r"^(?:(?:export|override)\s+)*([A-Za-z0-9_.+/-]+)\s*(::=|:=|\?=|\+=|=)\s*(.*)$"
+)
+makeInclude = re.compile(r"^-?s?include\s+(.+)$")
+makeDefine = re.compile(r"^define\s+(\S+)")
+makeDownloadCall = re.compile(r"^\$\(call\s+(Download/[^,)]+)((?:,[^,)]*)*)\)$")
+makeCond = re.compile(r"^(ifeq|ifneq|ifdef|ifndef)\b")
+kernelVersion = re.compile(r"^kernel-(\d+\.\d+)$")
+emptyField = re.compile(r"^[-_.]|--|[-_]v?\.(tar|t[gx]z|zip)\b|[-_]$")
+
+
+class MakeVars:
+    def __init__(self, tree, curdir):
+        self.vars = {
+            "TOPDIR": [tree],
+            "INCLUDE_DIR": [os.path.join(tree, "include")],
+            "CURDIR": [curdir],
+        }
+
+    def get(self, name):
+        return self.vars.get(name)
+
+    def assign(self, name, op, value, conditional):
+        old = self.vars.get(name)
+        if op == "?=" and old is not None and not conditional:
+            return
+        if op == "+=" and old is not None:
+            new = [(v + " " + value).strip() for v in old]
+        elif op in (":=", "::=") and ("$(" + name + ")") in value:
+            new = self.expand(value)
+        else:
+            new = [value]
+        if conditional and old is not None:
+            new = old + [v for v in new if v not in old]
+        self.vars[name] = new[:MAX_ALTERNATIVES]
+
+    def call(self, func, args, depth=0):
+        saved = dict(self.vars)
+        for i in range(1, 10):
+            self.vars[str(i)] = [args[i - 1] if i <= len(args) else ""]
+        result = []
+        for v in saved[func]:
+            result += self.expand(v, depth + 1)
+        self.vars = saved
+        return result
+
+    def _split(self, text):
+        # split function arguments at top level commas
+        args, depth, cur = [], 0, ""
+        for c in text:
+            if c in "({":
+                depth += 1
+            elif c in ")}":
+                depth -= 1
+            if c == "," and depth == 0:
+                args.append(cur)
+                cur = ""
+            else:
+                cur += c
+        args.append(cur)
+        return args
+
+    def _product(self, parts):
+        result = [""]
+        for alts in parts:
+            if len(result) * len(alts) > MAX_ALTERNATIVES:
+                alts = ["*"]
+            result = [r + a for r in result for a in alts]
+        return result
+
+    def _function(self, name, args, depth):
+        if name == "call":
+            args = self._split(args)
+            func = args[0].strip()
+            if func == "version_abbrev" and len(args) > 1:
+                return [v[:8] for v in self.expand(args[1], depth)]
+            if self.vars.get(func) is None:
+                return ["*"]
+            return self.call(func, [self.expand(a, depth)[0] for a in args[1:]], depth)
+        if name in ("strip", "firstword", "notdir"):
+            result = []
+            for v in self.expand(args, depth):
+                words = v.split()
+                if name == "firstword":
+                    words = words[:1]
+                elif name == "notdir":
+                    words = [os.path.basename(w) for w in words]
+                result.append(" ".join(words))
+            return result
+        if name in ("wildcard", "sort"):
+            # file name patterns stay patterns, include globs them
+            return self.expand(args, depth)
+        if name == "subst":
+            args = self._split(args)
+            if len(args) != 3:
+                return ["*"]
+            parts = [self.expand(a, depth) for a in args]
+            return [
+                t.replace(f, r) if f else t
+                for f in parts[0]
+                for r in parts[1]
+                for t in parts[2]
+            ][:MAX_ALTERNATIVES]
+        if name == "if":
+            args = self._split(args)
+            result = []
+            for a in args[1:3]:
+                result += self.expand(a, depth)
+            return result or [""]
+        return ["*"]
+
+    def _reference(self, ref, depth):
+        m = re.match(r"^([a-z]+)\s+(.*)$", ref, re.S)
+        if m and m.group(1) in ("call", "strip", "firstword", "notdir", "subst", "if",
+                                "wildcard", "sort"):
+            return self._function(m.group(1), m.group(2), depth)
+        if m or ":" in ref:
+            return ["*"]
+        result = []
+        for name in self.expand(ref, depth):
+            if "*" in name:
+                return ["*"]
+            value = self.vars.get(name.strip())
+            if value is None:
+                # set elsewhere (config symbols, include/toplevel.mk, the
+                # environment), so it may expand to anything
+                return ["*"]
+            for v in value:
+                result += self.expand(v, depth + 1)
+        return result[:MAX_ALTERNATIVES] or [""]
+
+    def expand(self, text, depth=0):
+        if depth > 16:
+            return ["*"]
+        parts = []
+        i = 0
+        while i < len(text):
+            j = text.find("$", i)
+            if j < 0:
+                parts.append([text[i:]])
+                break
+            parts.append([text[i:j]])
+            if j + 1 >= len(text):
+                break
+            c = text[j + 1]
+            if c == "$":
+                parts.append(["$"])
+                i = j + 2
+            elif c in "({":
+                close = ")" if c == "(" else "}"
+                level, k = 0, j + 1
+                while k < len(text):
+                    if text[k] == c:
+                        level += 1
+                    elif text[k] == close:
+                        level -= 1
+                        if level == 0:
+                            break
+                    k += 1
+                parts.append(self._reference(text[j + 2 : k], depth))
+                i = k + 1
+            else:
+                # automatic and single letter variables
+                parts.append(["*"])
+                i = j + 2
+        return self._product(parts)
+
+
+def packageName(mv):
+    """Returns PKG_NAME if it is known, to keep all files of a package"""
+    if mv.get("PKG_NAME") is None:
+        return None
+    names = mv.expand("$(PKG_NAME)")
+    if len(names) != 1 or "*" in names[0] or not names[0].strip():
+        return None
+    return names[0].strip()
+
+
+class SourceIndex:
+    def __init__(self):
+        self.files = {}
+        self.patterns = {}
+        self.makefiles = 0
+        self.unknown = {}
+        self.unknownHashes = set()
+        self.unresolved = []
+        self.includeCache = {}
+
+    def addUnknown(self, origin, hashes, package):
+        """Keeps what can still be recognized of a file whose name is unknown"""
+        if hashes:
+            self.unknownHashes |= hashes
+            self.unknown[origin] = "keeping files by hash"
+        elif package:
+            self.patterns.setdefault(package + "*", (set(), origin))
+            self.unknown[origin] = "keeping %s*" % package
+        else:
+            self.unresolved.append(origin)
+            self.unknown[origin] = "not deleting anything"
+
+    def add(self, names, hashes, origin, package=None):
+        hashes = set(h for h in hashes if re.match(r"^[0-9a-f]{32}([0-9a-f]{32})?$", h))
+        for name in names:
+            for word in name.split():
+                word = os.path.basename(word)
+                if not word:
+                    continue
+                if not word.strip("*"):
+                    # nothing known about the name, do not keep everything
+                    self.addUnknown(origin, hashes, package)
+                    continue
+                if "*" in word:
+                    self.patterns.setdefault(word, (set(), origin))[0].update(hashes)
+                else:
+                    self.files.setdefault(word, set()).update(hashes)
+
+    def lookup(self, name):
+        """Returns the known hashes of name, or None if it is not referenced"""
+        if name in self.files:
+            return self.files[name]
+        for pattern in self.patterns:
+            if fnmatch.fnmatchcase(name, pattern):
+                return self.patterns[pattern][0]
+        return None
+
+    def hashes(self):
+        result = set()
+        for h in self.files.values():
+            result |= h
+        for (h, origin) in self.patterns.values():
+            result |= h
+        return result
+
+    def _followInclude(self, tree, path):
+        # include/*.mk only matters if it sets the source file name
+        if not os.path.isfile(path):
+            return False
+        if os.path.dirname(path) != os.path.join(tree, "include"):
+            return True
+        if path not in self.includeCache:
+            with open(path, errors="replace") as f:
+                self.includeCache[path] = re.search(
+                    r"^PKG_SOURCE\s*[:?]?=", f.read(), re.M
+                ) is not None
+        return self.includeCache[path]
+
+    def _parse(self, tree, path, mv, downloads, seen):
+        if path in seen or not os.path.isfile(path):
+            return
+        seen.add(path)
+        with open(path, errors="replace") as f:
+            lines = f.read().replace("\\\n", " ").split("\n")
+
+        cond = 0
+        define = None
+        for line in lines:
+            # recipe lines, but Download/ definitions may be indented by tabs
+            if line.startswith("\t") and define is None:
+                continue
+            line = re.sub(r"(?<!\\)#.*", "", line).strip()
+            if define is not None:
+                if line == "endef":
+                    define = None
+                elif downloads is not None and define.startswith("Download/"):
+                    m = makeAssign.match(line)
+                    if m:
+                        downloads[define][0][m.group(1)] = m.group(3)
+                    m = makeDownloadCall.match(line)
+                    if m:
+                        downloads[define][1].append((m.group(1), m.group(2).split(",")[1:]))
+                continue
+            m = makeDefine.match(line)
+            if m:
+                define = m.group(1)
+                if define.startswith("Download/") and downloads is not None:
+                    downloads[define] = ({}, [])
+                continue
+            if makeCond.match(line):
+                cond += 1
+                continue
+            if line == "endif":
+                cond = max(cond - 1, 0)
+                continue
+            m = makeInclude.match(line)
+            if m:
+                for inc in mv.expand(m.group(1)):
+                    for name in inc.split():
+                        name = os.path.join(mv.get("CURDIR")[0], name)
+                        if "*" not in name:
+                            found = [name]
+                        elif "*" not in os.path.dirname(name):
+                            # e.g. $(SUBTARGET).mk: follow every candidate
+                            found = sorted(glob.glob(name))
+                        else:
+                            found = []
+                        if not found:
+                            # may define sources or Download/ of its own
+                            if downloads is not None and not line.startswith(("-", "s")):
+                                self.addUnknown("%s: include %s" % (path, m.group(1)),
+                                                set(), packageName(mv))
+                        for name in found:
+                            if self._followInclude(tree, name):
+                                self._parse(tree, os.path.normpath(name), mv, downloads, seen)
+                continue
+            m = makeAssign.match(line)
+            if m:
+                mv.assign(m.group(1), m.group(2), m.group(3), cond > 0)
+
+    def scanMakefile(self, tree, path):
+        mv = MakeVars(tree, os.path.dirname(path))
+        downloads = {}
+        self._parse(tree, path, mv, downloads, set())
+        self.makefiles += 1
+
+        def values(name):
+            return mv.expand("$(" + name + ")") if mv.get(name) is not None else []
+
+        # defaults from include/download.mk for sources fetched from VCS, which
+        # is included after the Makefile and anything it includes itself
+        if mv.get("PKG_SOURCE_VERSION") is not None:
+            if mv.get("PKG_VERSION") is None:
+                if mv.get("PKG_SOURCE_DATE") is not None:
+                    version = "$(subst -,.,$(PKG_SOURCE_DATE))"
+                else:
+                    version = "0"
+                mv.assign("PKG_VERSION", "=",
+                          version + "~$(call version_abbrev,$(PKG_SOURCE_VERSION))", False)
+            mv.assign("PKG_SOURCE_SUBDIR", "?=", "$(PKG_NAME)-$(PKG_VERSION)", False)
+            mv.assign("PKG_SOURCE", "?=", "$(PKG_SOURCE_SUBDIR).tar.zst", False)
+
+        package = packageName(mv)
+        if mv.get("PKG_SOURCE") is not None:
+            self.add(values("PKG_SOURCE"),
+                     values("PKG_HASH") + values("PKG_MIRROR_HASH"), path, package)
+
+        # Download/ definitions used as templates by other Download/ definitions
+        # are only meaningful with the arguments passed by these
+        templates = set(t for (assigns, calls) in downloads.values() for (t, args) in calls)
+        for (name, (assigns, calls)) in downloads.items():
+            if name in templates:
+                continue
+            local = MakeVars(tree, os.path.dirname(path))
+            local.vars = dict(mv.vars)
+            for (template, args) in calls:
+                for i in range(1, 10):
+                    local.vars[str(i)] = [args[i - 1].strip() if i <= len(args) else ""]
+                for (var, value) in downloads.get(template, ({}, []))[0].items():
+                    local.assign(var, ":=", value, False)
+                    local.vars[var] = local.expand(value)
+            for (var, value) in assigns.items():
+                local.assign(var, "=", value, False)
+            hashes = ((local.expand("$(HASH)") if local.get("HASH") is not None else []) +
+                      (local.expand("$(MIRROR_HASH)") if local.get("MIRROR_HASH") is not None else []))
+            if local.get("FILE") is None:
+                self.add(["*"], hashes, path + ":" + name, package)
+                continue
+            self.add(local.expand("$(FILE)"), hashes, path + ":" + name, package)
+
+    def scanKernel(self, tree, path, patchver):
+        mv = MakeVars(tree, os.path.dirname(path))
+        self._parse(tree, path, mv, None, set())
+        for sub in mv.expand("$(LINUX_VERSION-" + patchver + ")"):
+            version = patchver + sub.strip()
+            self.add(["linux-" + version + ".tar.xz"],
+                     mv.expand("$(LINUX_KERNEL_HASH-" + version + ")"), path)
+
+    def scanTree(self, tree):
+        for top in gcScanDirs:
+            for (root, dirs, files) in os.walk(os.path.join(tree, top)):
+                dirs[:] = [d for d in dirs if not d.startswith(".") and d not in ("src", "files", "patches")]
+                for name in files:
+                    path = os.path.join(root, name)
+                    if name == "Makefile":
+                        self.scanMakefile(tree, path)
+                    elif root.endswith("target/linux/generic") and kernelVersion.match(name):
+                        self.scanKernel(tree, path, kernelVersion.match(name).group(1))
+
+        # names from the package metadata dump, if the tree has been configured
+        packageinfo = os.path.join(tree, "tmp", ".packageinfo")
+        if os.path.isfile(packageinfo):
+            with open(packageinfo, errors="replace") as f:
+                for line in f:
+                    if line.startswith("Source: "):
+                        self.add([line[8:].strip()], [], packageinfo)
+
+
+def hashFile(path, expected):
+    """Returns True if the file matches one of the expected hashes"""
+    algos = {}
+    for h in expected:
+        algos.setdefault(len(h), set()).add(h)
+    for (length, hashes) in algos.items():
+        digest = hashlib.sha256() if length == 64 else hashlib.md5()
+        with open(path, "rb") as f:
+            while True:
+                buf = f.read(1 << 20)
+                if not buf:
+                    break
+                digest.update(buf)
+        if digest.hexdigest() in hashes:
+            return True
+    return False
+
+
+def formatSize(size):
+    for unit in ("B", "KiB", "MiB", "GiB"):
+        if size < 1024 or unit == "GiB":
+            return "%.1f %s" % (size, unit) if unit != "B" else "%d B" % size
+        size /= 1024.0
+
+
+def garbageCollect(directory, trees):
+    index = SourceIndex()
+    for tree in trees:
+        index.scanTree(os.path.abspath(tree))
+    print("Index: %d files and %d patterns referenced by %d Makefiles in %d tree(s)"
+          % (len(index.files), len(index.patterns), index.makefiles, len(trees)))
+    for (pattern, (hashes, origin)) in sorted(index.patterns.items()):
+        if not re.match(r"^[^*]{3}", pattern):
+            print("Warning: %s (from %s) matches many files" % (pattern, origin))
+    for (origin, action) in sorted(index.unknown.items()):
+        print("Warning: source file name from %s cannot be determined, %s"
+              % (origin, action))
+    # an empty version or other field points at a variable the index got wrong,
+    # and the file actually downloaded would then be deleted
+    for name in sorted(list(index.files) + list(index.patterns)):
+        if emptyField.search(name):
+            print("Warning: %s has an empty field, the index may be incomplete" % name)
+    knownHashes = index.hashes()
+
+    # (path, stat, expected hashes or None if unreferenced)
+    candidates = []
+    skipped = 0
+    for entry in os.scandir(directory):
+        name = entry.name
+        if name.startswith(".") or name.endswith((".part", ".dl", ".hash")):
+            continue
+        if entry.is_dir(follow_symlinks=False):
+            skipped += 1
+            continue
+        if any(regex.match(name) for (n, regex) in blacklist):
+            skipped += 1
+            continue
+        candidates.append((entry.path, entry.stat(follow_symlinks=False), index.lookup(name)))
+
+    cas = os.path.join(directory, ".by-hash")
+    if os.path.isdir(cas):
+        for entry in os.scandir(cas):
+            if entry.is_file(follow_symlinks=False):
+                candidates.append((entry.path, entry.stat(follow_symlinks=False),
+                                   {entry.name} if entry.name in knownHashes else None))
+
+    # files of Download/ definitions whose name is unknown, recognized by hash
+    if index.unknownHashes:
+        unnamed = [c for c in candidates if c[2] is None]
+        with concurrent.futures.ThreadPoolExecutor(max_workers=opt_jobs) as pool:
+            results = pool.map(lambda c: hashFile(c[0], index.unknownHashes), unnamed)
+            for (c, ok) in zip(unnamed, results):
+                if ok:
+                    candidates[candidates.index(c)] = (c[0], c[1], set())
+
+    delete = [c for c in candidates if c[2] is None]
+    keep = [c for c in candidates if c[2] is not None]
+
+    if index.unresolved and not opt_dryrun:
+        print("Error: the index is incomplete, see the warnings above. Not deleting anything.")
+        return 1
+
+    corrupt = []
+    unverified = 0
+    if opt_verify:
+        check = [c for c in keep if c[2]]
+        unverified = len(keep) - len(check)
+        with concurrent.futures.ThreadPoolExecutor(max_workers=opt_jobs) as pool:
+            results = pool.map(lambda c: hashFile(c[0], c[2]), check)
+            for (c, ok) in zip(check, results):
+                if not ok:
+                    print("Hash mismatch", c[0])
+                    corrupt.append(c)
+        keep = [c for c in keep if c not in corrupt]
+        delete += corrupt
+
+    # space is only reclaimed once the last link to an inode is gone
+    links = {}
+    for (path, st, hashes) in delete:
+        links.setdefault((st.st_dev, st.st_ino), []).append(st)
+    reclaimed = sum(sts[0].st_size for sts in links.values() if len(sts) >= sts[0].st_nlink)
+
+    for (path, st, hashes) in sorted(delete):
+        print("Deleting", path)
+        if not opt_dryrun:
+            os.unlink(path)
+
+    kept = dict(((c[1].st_dev, c[1].st_ino), c[1].st_size) for c in keep)
+    print("Kept %d files (%s), %d skipped"
+          % (len(keep), formatSize(sum(kept.values())), skipped))
+    if opt_verify:
+        print("Verified %d files, %d hash mismatches, %d without hash"
+              % (len(keep) + len(corrupt) - unverified, len(corrupt), unverified))
+    print("%s %d files, %s reclaimed"
+          % ("Would delete" if opt_dryrun else "Deleted", len(delete), formatSize(reclaimed)))
+    return 0
+
+
+def selfTest():
+    """Checks the index against a small tree, see --self-test"""
+    makefiles = {
+        "package/foo/Makefile": (
+            "PKG_NAME:=foo\n"
+            "PKG_VERSION:=1.0\n"
+            "PKG_SOURCE:=$(PKG_NAME)-$(PKG_VERSION).tar.gz\n"
+            "include $(TOPDIR)/rules.mk\n"
+            "include firmware.mk\n"
+            "include $(SUBTARGET).mk\n"
+        ),
+        "package/foo/firmware.mk": (
+            "FW_VERSION:=2.0\n"
+            "define Download/foo-fw\n"
+            "\tFILE:=foo-fw-$(FW_VERSION).bin\n"
+            "endef\n"
+            "$(eval $(call Download,foo-fw))\n"
+        ),
+        "package/foo/generic.mk": (
+            "define Download/foo-extra\n"
+            "  FILE:=foo-extra-$(HOST_ARCH).bin\n"
+            "endef\n"
+        ),
+        "package/bar/Makefile": (
+            "PKG_NAME:=bar\n"
+            "PKG_SOURCE_PROTO:=git\n"
+            "PKG_SOURCE_DATE:=2024-01-02\n"
+            "PKG_SOURCE_VERSION:=0123456789abcdef\n"
+            "include $(INCLUDE_DIR)/package.mk\n"
+        ),
+    }
+    referenced = ("foo-1.0.tar.gz", "foo-fw-2.0.bin", "foo-extra-x86_64.bin",
+                  "bar-2024.01.02~01234567.tar.zst")
+    unreferenced = ("foo-0.9.tar.gz", "foo-fw-1.0.bin", "bar-.tar.zst")
+
+    with tempfile.TemporaryDirectory() as tree:
+        for (name, text) in makefiles.items():
+            os.makedirs(os.path.dirname(os.path.join(tree, name)), exist_ok=True)
+            with open(os.path.join(tree, name), "w") as f:
+                f.write(text)
+        index = SourceIndex()
+        index.scanTree(tree)
+
+    errors = ["%s is not referenced" % n for n in referenced if index.lookup(n) is None]
+    errors += ["%s is referenced" % n for n in unreferenced if index.lookup(n) is not None]
+    for error in errors:
+        print("Self test failed:", error)
+    if not errors:
+        print("Self test passed")
+    return 1 if errors else 0
+
+
 def usage():
     print("OpenWrt download directory cleanup utility")
     print("Usage: " + sys.argv[0] + " [OPTIONS] <path/to/dl>")
@@ -217,15 +794,23 @@ def usage():
     print(
         " -b|--build-dir          Provide path to build dir to clean also the build directory"
     )
+    print(
+        " -g|--gc TREE            Delete all files not referenced by TREE (may be repeated)"
+    )
+    print(" -V|--verify             In gc mode, also delete files failing hash verification")
+    print(" -j|--jobs N             Number of parallel hash verifications")
+    print(" -T|--self-test          Check the gc index against a small test tree")
 
 
 def main(argv):
     global opt_dryrun
+    global opt_verify
+    global opt_jobs
 
     try:
         (opts, args) = getopt.getopt(
             argv[1:],
-            "hdBw:D:b:",
+            "hdBw:D:b:g:Vj:T",
             [
                 "help",
                 "dry-run",
@@ -233,6 +818,10 @@ def main(argv):
                 "whitelist=",
                 "download-dir=",
                 "build-dir=",
+                "gc=",
+                "verify",
+                "jobs=",
+                "self-test",
             ],
         )
     except getopt.GetoptError as e:
@@ -241,6 +830,7 @@ def main(argv):
 
     directory = "dl/"
     builddir = "build_dir/"
+    trees = []
 
     for (o, v) in opts:
         if o in ("-h", "--help"):
@@ -268,6 +858,14 @@ def main(argv):
             directory = v
         if o in ("-b", "--build-dir"):
             builddir = v
+        if o in ("-g", "--gc"):
+            trees.append(v)
+        if o in ("-V", "--verify"):
+            opt_verify = True
+        if o in ("-j", "--jobs"):
+            opt_jobs = max(int(v), 1)
+        if o in ("-T", "--self-test"):
+            return selfTest()
 
     if args:
         directory = args[0]
@@ -276,6 +874,13 @@ def main(argv):
         print("Can't find download directory", directory)
         return 1
 
+    if trees:
+        for tree in trees:
+            if not os.path.isdir(tree):
+                print("Can't find tree", tree)
+                return 1
+        return garbageCollect(directory, trees)
+
     if not os.path.exists(builddir):
         print("Can't find build directory", builddir)
         return 1
@@ -11,9 +11,12 @@ use strict;
 use warnings;
 use File::Basename;
 use File::Copy;
-use File::Path;
+use File::Path qw(make_path);
 use Text::ParseWords;
 use JSON::PP;
+use Digest::MD5;
+use Digest::SHA;
+use POSIX ":sys_wait_h";
 
 @ARGV > 2 or die "Syntax: $0 <target dir> <filename> <hash> <url filename> [<mirror> ...]\n";
 
@@ -80,15 +83,26 @@ sub which($) {
 	return $res;
 }
 
-sub hash_cmd() {
+sub hash_new() {
 	my $len = length($file_hash);
-	my $cmd;
 
-	$len == 64 and return "$ENV{'MKHASH'} sha256";
-	$len == 32 and return "$ENV{'MKHASH'} md5";
+	$len == 64 and return Digest::SHA->new(256);
+	$len == 32 and return Digest::MD5->new;
 	return undef;
 }
 
+sub hash_file($) {
+	my $file = shift;
+	my $digest = hash_new();
+
+	open my $fh, '<', $file or return undef;
+	binmode $fh;
+	$digest->addfile($fh);
+	close $fh;
+
+	return $digest;
+}
+
 sub tool_present {
 	my $tool_name = shift;
 	my $compare_line = shift;
@@ -122,10 +136,12 @@ sub select_tool {
 sub download_cmd {
 	my $url = shift;
 	my $filename = shift;
+	my $offset = shift;
 
 	if ($download_tool eq "curl") {
 		return (qw(curl -f --connect-timeout 20 --retry 5 --location),
 			$check_certificate ? () : '--insecure',
+			$offset ? ('--continue-at', $offset) : (),
 			shellwords($ENV{CURL_OPTIONS} || ''),
 			$url);
 	} elsif ($download_tool eq "wget") {
@@ -155,8 +171,142 @@ sub download_cmd {
 	}
 }
 
-my $hash_cmd = hash_cmd();
-$hash_cmd or ($file_hash eq "skip") or die "Cannot find appropriate hash command, ensure the provided hash is either a MD5 or SHA256 checksum.\n";
+sub probe_cmd {
+	my $url = shift;
+
+	if ($download_tool eq "curl") {
+		return (qw(curl -s -f -I --location --connect-timeout 5 --max-time 15 -o /dev/null),
+			$check_certificate ? () : '--insecure',
+			$url);
+	} elsif ($download_tool eq "wget") {
+		return (qw(wget -q --spider --tries=1 --timeout=5),
+			$check_certificate ? () : '--no-check-certificate',
+			$url);
+	}
+
+	return ();
+}
+
+# Probe the first few remote mirrors concurrently and return the index of
+# the first one that answers, killing the remaining probes. Mirrors that
+# do not respond are only reordered, never dropped, since some servers
+# reject HEAD requests but still serve the file.
+sub probe_mirrors {
+	my $download_filename = shift;
+	my @list = @_;
+	my $max_probes = $ENV{DOWNLOAD_PROBE_MIRRORS} // 8;
+	my %children;
+	my %seen;
+	my $winner;
+
+	return undef unless $max_probes > 0 && @list > 1;
+	return undef unless $download_tool eq "curl" or $download_tool eq "wget";
+
+	for my $i (0 .. $#list) {
+		my $mirror = $list[$i];
+		$mirror =~ s!/$!!;
+		next unless $mirror =~ m!^(https?|ftp)://! and $mirror !~ /a=snapshot/;
+		next if $seen{$mirror}++;
+		last if keys %children >= $max_probes;
+
+		my @cmd = probe_cmd("$mirror/$download_filename");
+		my $pid = fork();
+		defined $pid or last;
+		if (!$pid) {
+			open STDOUT, '>', '/dev/null';
+			open STDERR, '>', '/dev/null';
+			exec @cmd or POSIX::_exit(127);
+		}
+		$children{$pid} = $i;
+	}
+
+	while (keys %children) {
+		my $pid = waitpid(-1, 0);
+		last if $pid <= 0;
+		my $i = delete $children{$pid};
+		defined $i or next;
+		if ($? == 0) {
+			$winner = $i;
+			last;
+		}
+	}
+
+	kill 'TERM', keys %children;
+	waitpid($_, 0) for keys %children;
+
+	return $winner;
+}
+
+# Look up a file in a file:// mirror. Mirrors that are download
+# directories maintained by this script are checked through their
+# by-hash index and by name first, everything else through a cached
+# name index of the mirror tree that is rebuilt once when it misses.
+sub local_mirror_find {
+	my $mirror = shift;
+	my $name = shift;
+	my $index = "$target/.mirror-index/" . Digest::MD5::md5_hex($mirror);
+	my @found;
+
+	return "$mirror/.by-hash/$file_hash" if $file_hash ne "skip" && -f "$mirror/.by-hash/$file_hash";
+	return "$mirror/$name" if -f "$mirror/$name";
+
+	for my $rebuild (0, 1) {
+		if ($rebuild || ! -f $index) {
+			make_path(dirname($index));
+			system("find '$mirror' -follow -type f ! -path '*/.by-hash/*' > '$index.tmp' 2>/dev/null");
+			rename("$index.tmp", $index) or return;
+		}
+
+		@found = ();
+		if (open my $fh, '<', $index) {
+			while (my $line = <$fh>) {
+				chomp $line;
+				push @found, $line if basename($line) eq $name && -f $line;
+			}
+			close $fh;
+		}
+		last if @found;
+	}
+
+	if (@found > 1) {
+		print(scalar(@found) . " or more instances of $name in $mirror found . Only one instance allowed.\n");
+		return;
+	}
+
+	return $found[0];
+}
+
+# Keep a hardlink of every verified file in <target>/.by-hash so that
+# later lookups (from this or other trees using it as a file:// mirror)
+# can find it by hash regardless of its name.
+sub add_to_cas {
+	my $file = shift;
+
+	return if $file_hash eq "skip";
+	return if -f "$target/.by-hash/$file_hash";
+	make_path("$target/.by-hash");
+	link($file, "$target/.by-hash/$file_hash") or copy($file, "$target/.by-hash/$file_hash");
+}
+
+sub install_from_cas {
+	my $cas = "$target/.by-hash/$file_hash";
+
+	return 0 if $file_hash eq "skip" || ! -f $cas;
+
+	my $digest = hash_file($cas);
+	if (!$digest || $digest->hexdigest ne $file_hash) {
+		unlink $cas;
+		return 0;
+	}
+
+	print("Using $filename from $cas\n");
+	unlink "$target/$filename";
+	link($cas, "$target/$filename") or copy($cas, "$target/$filename") or return 0;
+	return 1;
+}
+
+my $has_hash = defined(hash_new());
+$has_hash or ($file_hash eq "skip") or die "Cannot find appropriate hash command, ensure the provided hash is either a MD5 or SHA256 checksum.\n";
 
 sub download
 {
@@ -164,6 +314,7 @@ sub download
 	my $download_filename = shift;
 	my @additional_mirrors = @_;
 	my @cmd;
+	my $digest;
 
 	$mirror =~ s!/$!!;
 
@@ -178,23 +329,7 @@ sub download
 			make_path($target);
 		}
 
-		if (! open TMPDLS, "find $mirror -follow -name $filename 2>/dev/null |") {
-			print("Failed to search for $filename in $mirror\n");
-			return;
-		}
-
-		my $link;
-
-		while (defined(my $line = readline TMPDLS)) {
-			chomp ($link = $line);
-			if ($. > 1) {
-				print("$. or more instances of $filename in $mirror found . Only one instance allowed.\n");
-				return;
-			}
-		}
-
-		close TMPDLS;
-
+		my $link = local_mirror_find($mirror, $filename);
 		if (! $link) {
 			print("No instances of $filename found in $mirror.\n");
 			return;
@@ -203,44 +338,68 @@ sub download
 		print("Copying $filename from $link\n");
 		copy($link, "$target/$filename.dl");
 
-		$hash_cmd and do {
-			if (system("cat '$target/$filename.dl' | $hash_cmd > '$target/$filename.hash'")) {
+		$has_hash and do {
+			$digest = hash_file("$target/$filename.dl");
+			if (!$digest) {
 				print("Failed to generate hash for $filename\n");
 				return;
 			}
 		};
 	} else {
+		my $part = "$target/$filename.part";
+		my $offset = -s $part;
+
+		# Resume a partial download left by an earlier attempt. Only curl
+		# can continue a transfer to stdout, so start over otherwise.
+		$offset = 0 unless $offset && $download_tool eq "curl";
+		$has_hash and do {
+			$digest = hash_new();
+			$offset and do {
+				my $prev = hash_file($part);
+				$prev ? ($digest = $prev) : ($offset = 0);
+			};
+		};
+
 		if ($mirror =~ /a=snapshot/) {
-			@cmd = download_cmd("$mirror", $download_filename, @additional_mirrors);
+			@cmd = download_cmd("$mirror", $download_filename, $offset, @additional_mirrors);
 		} else {
-			@cmd = download_cmd("$mirror/$download_filename", $download_filename, @additional_mirrors);
+			@cmd = download_cmd("$mirror/$download_filename", $download_filename, $offset, @additional_mirrors);
 		}
 		print STDERR "+ ".join(" ",@cmd)."\n";
+		$offset and print STDERR "Resuming download of $filename at byte $offset\n";
 		open(FETCH_FD, '-|', @cmd) or die "Cannot launch aria2c, curl or wget.\n";
-		$hash_cmd and do {
-			open MD5SUM, "| $hash_cmd > '$target/$filename.hash'" or die "Cannot launch $hash_cmd.\n";
-		};
-		open OUTPUT, "> $target/$filename.dl" or die "Cannot create file $target/$filename.dl: $!\n";
+		open OUTPUT, ($offset ? ">>" : ">"), $part or die "Cannot create file $part: $!\n";
+		binmode FETCH_FD;
+		binmode OUTPUT;
 		my $buffer;
 		while (read FETCH_FD, $buffer, 1048576) {
-			$hash_cmd and print MD5SUM $buffer;
+			$digest and $digest->add($buffer);
 			print OUTPUT $buffer;
 		}
-		$hash_cmd and close MD5SUM;
 		close FETCH_FD;
+		my $status = $? >> 8;
 		close OUTPUT;
 
-		if ($? >> 8) {
+		# curl exits with 33 if the server does not support ranges
+		if ($offset && $status == 33) {
+			print STDERR "Server does not support resuming, restarting download.\n";
+			unlink $part;
+			return download($mirror, $download_filename, @additional_mirrors);
+		}
+
+		if ($status) {
 			print STDERR "Download failed.\n";
+			# keep what was transferred so far for the next mirror or run
+			-s $part or unlink $part;
 			cleanup();
 			return;
 		}
+
+		move($part, "$target/$filename.dl");
 	}
 
-	$hash_cmd and do {
-		my $sum = `cat "$target/$filename.hash"`;
-		$sum =~ /^(\w+)\s*/ or die "Could not generate file hash\n";
-		$sum = $1;
+	$digest and do {
+		my $sum = $digest->hexdigest;
 
 		if ($sum ne $file_hash) {
 			print STDERR "Hash of the downloaded file does not match (file: $sum, requested: $file_hash) - deleting download.\n";
@@ -251,6 +410,7 @@ sub download
 
 	unlink "$target/$filename";
 	move("$target/$filename.dl", "$target/$filename");
+	add_to_cas("$target/$filename");
 	cleanup();
 }
 
@@ -303,23 +463,23 @@ foreach my $mirror (@ARGV) {
 projectsmirrors '@OPENWRT';
 
 if (-f "$target/$filename") {
-	$hash_cmd and do {
-		if (system("cat '$target/$filename' | $hash_cmd > '$target/$filename.hash'")) {
-			die "Failed to generate hash for $filename\n";
-		}
-
-		my $sum = `cat "$target/$filename.hash"`;
-		$sum =~ /^(\w+)\s*/ or die "Could not generate file hash\n";
-		$sum = $1;
+	$has_hash and do {
+		my $digest = hash_file("$target/$filename") or die "Failed to generate hash for $filename\n";
+		my $sum = $digest->hexdigest;
 
 		cleanup();
-		exit 0 if $sum eq $file_hash;
+		if ($sum eq $file_hash) {
+			add_to_cas("$target/$filename");
+			exit 0;
+		}
 
 		die "Hash of the local file $filename does not match (file: $sum, requested: $file_hash) - deleting download.\n";
 		unlink "$target/$filename";
 	};
 }
 
+install_from_cas() and exit 0;
+
 $download_tool = select_tool();
 
 my $mirror = shift @mirrors;
@@ -330,6 +490,17 @@ if ($mirror =~ /snapshot/) {
 	$mirror = shift @mirrors;
 }
 
+# Start with the first mirror that responds instead of waiting for dead
+# ones to time out one after another
+if ($mirror && $mirror !~ m!^file://!) {
+	my @list = ($mirror, @mirrors);
+	my $winner = probe_mirrors($url_filename, @list);
+	if ($winner) {
+		$mirror = splice(@list, $winner, 1);
+		@mirrors = @list;
+	}
+}
+
 while (!-f "$target/$filename") {
 	$mirror or die "No more mirrors to try - giving up.\n";
 
@@ -0,0 +1,134 @@
+#!/usr/bin/env perl
+#
+# Copyright (C) 2025 OpenWrt.org
+#
+# This is free software, licensed under the GNU General Public License v2.
+# See /LICENSE for more information.
+#
+# Reads NUL separated file names from stdin and prints one line per ELF
+# file, by parsing the ELF header directly instead of running file(1).
+# Fields are separated by the ASCII unit separator (0x1f):
+#
+#   <type> <US> <mode> <US> <size> <US> <rpath> <US> <file>
+#
+# <type> is "executable", "shared object" or "relocatable", matching the
+# wording of file(1). <rpath> is the DT_RUNPATH or DT_RPATH string, or
+# empty if the file has none. Hardlinked files are only listed once, so
+# that they are not modified by two parallel strip jobs.
+
+use strict;
+use warnings;
+
+use constant {
+	ET_REL => 1,
+	ET_EXEC => 2,
+	ET_DYN => 3,
+	PT_LOAD => 1,
+	PT_DYNAMIC => 2,
+	PT_INTERP => 3,
+	DT_NULL => 0,
+	DT_STRTAB => 5,
+	DT_RPATH => 15,
+	DT_RUNPATH => 29,
+};
+
+sub elf_read($$$) {
+	my ($fh, $offset, $len) = @_;
+	my $buf;
+
+	seek($fh, $offset, 0) or return;
+	read($fh, $buf, $len) == $len or return;
+	return $buf;
+}
+
+sub elf_info($) {
+	my $file = shift;
+	my ($fh, $hdr);
+
+	open $fh, '<', $file or return;
+	binmode $fh;
+	read($fh, $hdr, 64);
+	return unless defined($hdr) && length($hdr) >= 52 && substr($hdr, 0, 4) eq "\x7fELF";
+
+	my $is64 = ord(substr($hdr, 4, 1)) == 2;
+	my $le = ord(substr($hdr, 5, 1)) == 1;
+	my ($h, $w, $a) = $le ? ('v', 'V', 'Q<') : ('n', 'N', 'Q>');
+	my $addr = $is64 ? $a : $w;
+
+	my $type = unpack($h, substr($hdr, 16, 2));
+	return 'relocatable', '' if $type == ET_REL;
+	return unless $type == ET_EXEC || $type == ET_DYN;
+
+	my ($phoff, $phentsize, $phnum);
+	if ($is64) {
+		return unless length($hdr) >= 64;
+		$phoff = unpack($a, substr($hdr, 32, 8));
+		($phentsize, $phnum) = unpack("$h$h", substr($hdr, 54, 4));
+	} else {
+		$phoff = unpack($w, substr($hdr, 28, 4));
+		($phentsize, $phnum) = unpack("$h$h", substr($hdr, 42, 4));
+	}
+
+	my $phdrs = elf_read($fh, $phoff, $phentsize * $phnum);
+	return ($type == ET_EXEC ? 'executable' : 'shared object'), '' unless defined $phdrs;
+
+	my (@load, $dynamic, $interp);
+	for my $i (0 .. $phnum - 1) {
+		my $ph = substr($phdrs, $i * $phentsize, $phentsize);
+		my ($p_type, $p_offset, $p_vaddr, $p_filesz);
+		if ($is64) {
+			$p_type = unpack($w, substr($ph, 0, 4));
+			($p_offset, $p_vaddr) = unpack("$a$a", substr($ph, 8, 16));
+			$p_filesz = unpack($a, substr($ph, 32, 8));
+		} else {
+			($p_type, $p_offset, $p_vaddr) = unpack("$w$w$w", substr($ph, 0, 12));
+			$p_filesz = unpack($w, substr($ph, 16, 4));
+		}
+		push @load, [ $p_offset, $p_vaddr, $p_filesz ] if $p_type == PT_LOAD;
+		$dynamic = [ $p_offset, $p_filesz ] if $p_type == PT_DYNAMIC;
+		$interp = 1 if $p_type == PT_INTERP;
+	}
+
+	# PIE binaries are ET_DYN with an interpreter
+	my $desc = ($type == ET_EXEC || $interp) ? 'executable' : 'shared object';
+	return $desc, '' unless $dynamic;
+
+	my $entsize = $is64 ? 16 : 8;
+	my $dyn = elf_read($fh, $dynamic->[0], $dynamic->[1]) // '';
+	my ($strtab, $rpath);
+	for (my $i = 0; $i + $entsize <= length($dyn); $i += $entsize) {
+		my ($tag, $val) = unpack("$addr$addr", substr($dyn, $i, $entsize));
+		last if $tag == DT_NULL;
+		$strtab = $val if $tag == DT_STRTAB;
+		$rpath = $val if $tag == DT_RUNPATH || ($tag == DT_RPATH && !defined $rpath);
+	}
+	return $desc, '' unless defined($strtab) && defined($rpath);
+
+	# DT_STRTAB is a virtual address, map it to a file offset
+	foreach my $seg (@load) {
+		my ($offset, $vaddr, $filesz) = @$seg;
+		next unless $strtab >= $vaddr && $strtab < $vaddr + $filesz;
+		my $pos = $offset + $strtab - $vaddr + $rpath;
+		my $len = (-s $fh) - $pos;
+		$len = 4096 if $len > 4096;
+		return $desc, '' if $len <= 0;
+
+		my $str = elf_read($fh, $pos, $len) // '';
+		$str =~ s/\0.*//s;
+		return $desc, $str;
+	}
+
+	return $desc, '';
+}
+
+my %seen;
+
+$/ = "\0";
+while (my $file = <STDIN>) {
+	chomp $file;
+	my @st = stat($file) or next;
+	next if $st[3] > 1 && $seen{"$st[0]:$st[1]"}++;
+	my ($type, $rpath) = elf_info($file);
+	next unless $type;
+	printf "%s\x1f%o\x1f%d\x1f%s\x1f%s\n", $type, $st[2] & 07777, $st[7], $rpath, $file;
+}
@@ -0,0 +1,86 @@
+#!/usr/bin/env bash
+#
+# Copyright (C) 2025 OpenWrt.org
+#
+# This is free software, licensed under the GNU General Public License v2.
+# See /LICENSE for more information.
+#
+# Content-addressed cache for image build steps whose output only depends
+# on their input file and arguments (e.g. Build/lzma).
+#
+# usage: image-cache.sh <cache dir> <input> <output> <command>
+#        image-cache.sh --stats <cache dir> [<max size in MiB>]
+#
+# The cache key is made from the hash of <input>, the command with the
+# input and output paths replaced by placeholders and the hash of the tool
+# binary. On a hit <output> is copied from the cache, otherwise <command>
+# is run and its output stored.
+#
+# --stats reports the hits and misses since the last call and then removes
+# the least recently used entries until the cache fits into the given size
+# (default 512 MiB). Hits update the mtime of an entry, atime is not used
+# since build directories are often mounted noatime.
+
+SELF=${0##*/}
+MKHASH=${MKHASH:-mkhash}
+
+now() {
+	[ -n "$EPOCHREALTIME" ] && echo "${EPOCHREALTIME/,/.}" || date +%s
+}
+
+prune() {
+	local dir="$1" max=$(( ${2:-512} * 1024 * 1024 ))
+
+	find "$dir" -maxdepth 1 -type f ! -name '*.*' ! -name stats -printf '%T@ %s %p\n' | \
+		sort -rn | awk -v max="$max" '{ total += $2; if (total > max) print $3 }' | \
+		while read -r file; do
+			rm -f "$file" "$file.time"
+		done
+}
+
+if [ "$1" = "--stats" ]; then
+	[ -d "$2" ] || exit 0
+	[ -s "$2/stats" ] && awk -v self="$SELF" '
+		$1 == "hit" { hit++; saved += $2 }
+		$1 == "miss" { miss++; spent += $2 }
+		END {
+			printf "%s: %d of %d steps cached, %.1fs saved, %.1fs spent on misses\n",
+				self, hit, hit + miss, saved, spent
+		}' "$2/stats"
+	rm -f "$2/stats"
+	prune "$2" "$3"
+	exit 0
+fi
+
+dir="$1"; in="$2"; out="$3"; cmd="$4"
+
+[ -n "$dir" -a -f "$in" ] || exec bash -c "$cmd"
+
+tool="${cmd%% *}"
+norm="${cmd//"$out"/@OUT@}"
+norm="${norm//"$in"/@IN@}"
+key=$( {
+	$MKHASH sha256 "$in"
+	echo "$norm"
+	[ -f "$tool" ] && $MKHASH sha256 "$tool"
+} | $MKHASH sha256)
+[ -n "$key" ] || exec bash -c "$cmd"
+
+mkdir -p "$dir"
+if [ -f "$dir/$key" ]; then
+	cp "$dir/$key" "$out" && {
+		touch "$dir/$key"
+		echo "$SELF: $(basename "$in"): reusing cached output of ${tool##*/}"
+		echo "hit $(cat "$dir/$key.time" 2>/dev/null || echo 0)" >> "$dir/stats"
+		exit 0
+	}
+fi
+
+start=$(now)
+bash -c "$cmd" || exit $?
+end=$(now)
+
+time=$(awk -v s="$start" -v e="$end" 'BEGIN { printf "%.3f", e - s }')
+cp "$out" "$dir/$key.$$" && mv "$dir/$key.$$" "$dir/$key"
+echo "$time" > "$dir/$key.time"
+echo "miss $time" >> "$dir/stats"
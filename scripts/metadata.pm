@@ -2,7 +2,7 @@ package metadata;
 use base 'Exporter';
 use strict;
 use warnings;
-our @EXPORT = qw(%package %vpackage %srcpackage %category %overrides clear_packages parse_package_metadata parse_package_manifest_metadata parse_target_metadata get_multiline @ignore %usernames %groupnames);
+our @EXPORT = qw(%package %vpackage %srcpackage %category %overrides clear_packages parse_package_metadata parse_package_manifest_metadata parse_target_metadata get_multiline package_dep_closure @ignore %usernames %groupnames);
 
 our %package;
 our %vpackage;
@@ -16,6 +16,9 @@ our %groupnames;
 our %userids;
 our %groupids;
 
+# memoised transitive dependency closure, see package_dep_closure()
+my %dep_closure;
+
 sub get_multiline {
 	my $fh = shift;
 	my $prefix = shift;
@@ -195,6 +198,31 @@ sub clear_packages() {
 	%overrides = ();
 	%usernames = ();
 	%groupnames = ();
+	%dep_closure = ();
+}
+
+# Returns a hash ref of the names of all packages reachable from $pkg through
+# plain (unconditional, non-select) dependencies, resolved via %vpackage.
+# Computed once per package and cached until the next clear_packages().
+sub package_dep_closure($) {
+	my $pkg = shift;
+	my $name = $pkg->{name};
+
+	return $dep_closure{$name} if $dep_closure{$name};
+
+	my %seen;
+	my @stack = ($pkg);
+	while (my $cur = pop @stack) {
+		foreach my $vpkg (@{$cur->{depends} || []}) {
+			foreach my $dep (@{$vpackage{$vpkg} || []}) {
+				next if $seen{$dep->{name}};
+				$seen{$dep->{name}} = 1;
+				push @stack, $dep;
+			}
+		}
+	}
+
+	return $dep_closure{$name} = \%seen;
 }
 
 sub parse_package_metadata($) {
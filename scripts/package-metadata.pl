@@ -99,31 +99,11 @@ sub gen_kconfig_overrides() {
 	}
 }
 
-my %dep_check;
-sub __find_package_dep($$) {
-	my $pkg = shift;
-	my $name = shift;
-	my $deps = $pkg->{depends};
-
-	return 0 unless defined $deps;
-	foreach my $vpkg (@{$deps}) {
-		foreach my $dep (@{$vpackage{$vpkg}}) {
-			next if $dep_check{$dep->{name}};
-			$dep_check{$dep->{name}} = 1;
-			return 1 if $dep->{name} eq $name;
-			return 1 if (__find_package_dep($dep, $name) == 1);
-		}
-	}
-	return 0;
-}
-
-# wrapper to avoid infinite recursion
 sub find_package_dep($$) {
 	my $pkg = shift;
 	my $name = shift;
 
-	%dep_check = ();
-	return __find_package_dep($pkg, $name);
+	return package_dep_closure($pkg)->{$name} ? 1 : 0;
 }
 
 sub package_depends($$) {
@@ -142,6 +122,40 @@ sub package_depends($$) {
 	return $ret;
 }
 
+# provider index: names of the packages that can satisfy a selected
+# dependency, preferred variant first
+my %select_providers;
+sub select_providers($) {
+	my $depend = shift;
+	my $vdep = $vpackage{$depend};
+
+	return unless $vdep;
+	return $select_providers{$depend} if $select_providers{$depend};
+
+	my @vdeps;
+	foreach my $v (@$vdep) {
+		next if $v->{buildonly};
+		if ($v->{variant_default}) {
+			unshift @vdeps, $v->{name};
+		} else {
+			push @vdeps, $v->{name};
+		}
+	}
+
+	return $select_providers{$depend} = \@vdeps;
+}
+
+my %depends_expr;
+sub depends_expr($) {
+	my $depend = shift;
+
+	return $depends_expr{$depend} if exists $depends_expr{$depend};
+
+	my $vdep = $vpackage{$depend};
+	return $depends_expr{$depend} = undef unless $vdep && @$vdep > 0;
+	return $depends_expr{$depend} = join("||", map { "PACKAGE_".$_->{name} } @$vdep);
+}
+
 sub mconf_depends {
 	my $pkgname = shift;
 	my $depends = shift;
@@ -179,18 +193,9 @@ sub mconf_depends {
 			$depend = $2;
 		}
 		if ($flags =~ /\+/) {
-			my $vdep = $vpackage{$depend};
+			my $vdep = select_providers($depend);
 			if ($vdep) {
-				my @vdeps;
-
-				foreach my $v (@$vdep) {
-					next if $v->{buildonly};
-					if ($v->{variant_default}) {
-						unshift @vdeps, $v->{name};
-					} else {
-						push @vdeps, $v->{name};
-					}
-				}
+				my @vdeps = @$vdep;
 
 				$depend = shift @vdeps;
 
@@ -212,9 +217,9 @@ sub mconf_depends {
 
 			$flags =~ /@/ or $depend = "PACKAGE_$depend";
 		} else {
-			my $vdep = $vpackage{$depend};
-			if ($vdep && @$vdep > 0) {
-				$depend = join("||", map { "PACKAGE_".$_->{name} } @$vdep);
+			my $expr = depends_expr($depend);
+			if (defined $expr) {
+				$depend = $expr;
 			} else {
 				$flags =~ /@/ or $depend = "PACKAGE_$depend";
 			}
@@ -378,14 +383,17 @@ sub gen_condition ($) {
 	return join("", map(and_condition($_), split('\|\|', $condition)));
 }
 
+my %condition_cache;
 sub get_conditional_dep($$) {
 	my $condition = shift;
 	my $depstr = shift;
 	if ($condition) {
 		if ($condition =~ /^!(.+)/) {
-			return "\$(if " . gen_condition($1) . ",,$depstr)";
+			my $cond = $condition_cache{$1} //= gen_condition($1);
+			return "\$(if $cond,,$depstr)";
 		} else {
-			return "\$(if " . gen_condition($condition) . ",$depstr)";
+			my $cond = $condition_cache{$condition} //= gen_condition($condition);
+			return "\$(if $cond,$depstr)";
 		}
 	} else {
 		return $depstr;
@@ -581,10 +589,10 @@ sub gen_version_filtered_list() {
 
 sub gen_usergroup_list() {
 	parse_package_metadata($ARGV[0]) or exit 1;
-	for my $name (keys %usernames) {
+	for my $name (sort keys %usernames) {
 		print "user $name $usernames{$name}{id} $usernames{$name}{makefile}\n";
 	}
-	for my $name (keys %groupnames) {
+	for my $name (sort keys %groupnames) {
 		print "group $name $groupnames{$name}{id} $groupnames{$name}{makefile}\n";
 	}
 }
@@ -793,8 +801,44 @@ sub gen_package_cyclonedxsbom() {
 	print dump_cyclonedxsbom_json(@components);
 }
 
+# With --output, only replace the output file if its content changed, so
+# that its timestamp can be used to skip dependent steps.
+sub write_output($$) {
+	my $file = shift;
+	my $data = shift;
+
+	if (open my $fh, '<', $file) {
+		local $/;
+		my $old = <$fh>;
+		close $fh;
+		return if defined($old) && $old eq $data;
+	}
+
+	open my $fh, '>', "$file.tmp" or die "Cannot write $file.tmp: $!\n";
+	print $fh $data;
+	close $fh or die "Cannot write $file.tmp: $!\n";
+	rename "$file.tmp", $file or die "Cannot rename $file.tmp: $!\n";
+}
+
 sub parse_command() {
-	GetOptions("ignore=s", \@ignore);
+	my $output;
+	GetOptions("ignore=s", \@ignore, "output=s", \$output);
+
+	if ($output) {
+		my $data = '';
+		open my $fh, '>', \$data or die;
+		my $stdout = select $fh;
+		run_command();
+		select $stdout;
+		close $fh;
+		write_output($output, $data);
+		return;
+	}
+
+	run_command();
+}
+
+sub run_command() {
 	my $cmd = shift @ARGV;
 	for ($cmd) {
 		/^mk$/ and return gen_package_mk();
@@ -827,6 +871,7 @@ Available Commands:
 
 Options:
 	--ignore <name>				Ignore the source package <name>
+	--output <file>				Write to <file>, leaving it untouched if unchanged
 EOF
 }
 
@@ -0,0 +1,237 @@
+#!/usr/bin/env perl
+#
+# Copyright (C) 2025 OpenWrt.org
+#
+# This is free software, licensed under the GNU General Public License v2.
+# See /LICENSE for more information.
+#
+# Order the package build directories so that make starts the packages
+# on the longest chain of remaining build time first. The durations are
+# taken from a previous build profile (CONFIG_BUILD_PROFILE), the
+# dependencies from tmp/.packagedeps.
+#
+# With --dry-run, simulate the package compile phase with <jobs> parallel
+# slots and compare the predicted time of the default (alphabetical) order
+# with the prioritized one.
+
+use strict;
+use warnings;
+use Getopt::Long;
+use JSON::PP;
+
+my $jobs;
+my $dry_run;
+
+GetOptions('jobs|j=i' => \$jobs, 'dry-run|n' => \$dry_run) && @ARGV == 2
+	or die "Usage: $0 [--dry-run] [-j <jobs>] <tmp/.packagedeps> <logs/profile.log>\n";
+
+my ($depfile, $log) = @ARGV;
+my (%dirs, %deps, %rdeps, %duration, %prio);
+
+$jobs ||= do {
+	my $n = `nproc 2>/dev/null` || `sysctl -n hw.ncpu 2>/dev/null` || 1;
+	int($n) || 1;
+};
+
+# host and variant builds are scheduled together with their build dir
+sub builddir($) {
+	my $dir = shift;
+
+	$dir =~ s!/host$!!;
+	return $dir;
+}
+
+sub parse_deps() {
+	my $fh;
+
+	open $fh, '<', $depfile or die "Cannot open $depfile: $!\n";
+	while (<$fh>) {
+		$dirs{$1} = 1 if /^package-\S* \+= (\S+)$/;
+		next unless /^\$\(curdir\)\/(\S+)\/compile \+= (.*)$/;
+		my $dir = builddir($1);
+		my $list = $2;
+
+		while ($list =~ /\$\(curdir\)\/([^\s)]+)\/compile/g) {
+			my $dep = builddir($1);
+
+			next if $dep eq $dir;
+			$deps{$dir}{$dep} = 1;
+			$rdeps{$dep}{$dir} = 1;
+		}
+	}
+	close $fh;
+}
+
+# use the latest duration of every step, summed up per build dir
+#
+# The profile log only grows, so the parsed durations are kept in
+# <log>.durations together with the log offset they cover, and only the
+# records appended since then are parsed.
+sub parse_profile() {
+	my $json = JSON::PP->new;
+	my $cache = "$log.durations";
+	my ($offset, %steps, $fh) = (0);
+
+	if (open $fh, '<', $cache) {
+		$offset = <$fh> // 0;
+		chomp $offset;
+		while (<$fh>) {
+			chomp;
+			my ($dir, $step, $time) = split /\t/;
+			$steps{$dir}{$step} = $time if defined $time;
+		}
+		close $fh;
+	}
+
+	open $fh, '<', $log or die "Cannot open $log: $!\n";
+	if ($offset > -s $fh) {
+		# log was truncated or replaced
+		$offset = 0;
+		%steps = ();
+	}
+	seek $fh, $offset, 0;
+	while (my $line = <$fh>) {
+		# incomplete last line, parse it next time
+		last unless $line =~ /\n$/;
+		$offset += length $line;
+
+		my $rec = eval { $json->decode($line) } or next;
+
+		next if defined $rec->{event};
+		next unless $rec->{step} =~ m!^package/(.+)/((?:host-)?compile)$!;
+		$steps{$1}{$2} = $rec->{end} - $rec->{start};
+	}
+	close $fh;
+
+	if (open $fh, '>', "$cache.$$") {
+		print $fh "$offset\n";
+		foreach my $dir (sort keys %steps) {
+			print $fh "$dir\t$_\t$steps{$dir}{$_}\n" foreach sort keys %{$steps{$dir}};
+		}
+		close $fh;
+		rename "$cache.$$", $cache or unlink "$cache.$$";
+	}
+
+	foreach my $step (keys %steps) {
+		my $dir = $step;
+
+		# strip the build variant
+		$dir =~ s!/[^/]+$!! if !$dirs{$dir} && $dir =~ m!^(.+)/[^/]+$! && $dirs{$1};
+		# host and target compile of a package both count
+		$duration{$dir} += $_ foreach values %{$steps{$step}};
+	}
+}
+
+# remaining build time of the longest chain of packages depending on $dir,
+# including $dir itself
+sub priority($);
+sub priority($) {
+	my $dir = shift;
+	my $max = 0;
+
+	return $prio{$dir} if defined $prio{$dir};
+
+	$prio{$dir} = 0;
+	foreach my $rdep (keys %{$rdeps{$dir} // {}}) {
+		my $p = priority($rdep);
+		$max = $p if $p > $max;
+	}
+
+	return $prio{$dir} = ($duration{$dir} // 0) + $max;
+}
+
+# make builds the prerequisites of each directory before the directory
+# itself, so expand the list into that order
+sub make_order(@) {
+	my %known = map { $_ => 1 } @_;
+	my (%seen, @order);
+	my $visit;
+
+	$visit = sub {
+		my $dir = shift;
+
+		return if $seen{$dir}++;
+		$visit->($_) foreach grep { $known{$_} } sort keys %{$deps{$dir} // {}};
+		push @order, $dir;
+	};
+	$visit->($_) foreach @_;
+
+	return @order;
+}
+
+sub simulate(@) {
+	my @order = make_order(@_);
+	my %known = map { $_ => 1 } @order;
+	my (%pending, @running);
+	my $now = 0;
+
+	foreach my $dir (@order) {
+		$pending{$dir} = scalar grep { $known{$_} } keys %{$deps{$dir} // {}};
+	}
+
+	my @queue = @order;
+	while (@queue || @running) {
+		# fill free slots in list order, like make walking its prerequisites
+		my @wait;
+		foreach my $dir (@queue) {
+			if (@running < $jobs && !$pending{$dir}) {
+				push @running, [ $now + ($duration{$dir} // 0), $dir ];
+			} else {
+				push @wait, $dir;
+			}
+		}
+		@queue = @wait;
+
+		last unless @running;
+		@running = sort { $a->[0] <=> $b->[0] } @running;
+		my ($end, $dir) = @{shift @running};
+		$now = $end;
+		foreach my $rdep (keys %{$rdeps{$dir} // {}}) {
+			$pending{$rdep}-- if $known{$rdep};
+		}
+	}
+
+	return $now;
+}
+
+sub fmt_time($) {
+	my $t = shift;
+
+	return sprintf("%dh%02dm%02ds", $t / 3600, ($t / 60) % 60, $t % 60) if $t >= 3600;
+	return sprintf("%dm%02ds", $t / 60, $t % 60) if $t >= 60;
+	return sprintf("%.1fs", $t);
+}
+
+parse_deps();
+parse_profile();
+
+priority($_) foreach (keys %deps, keys %rdeps, keys %duration);
+my @order = sort { $prio{$b} <=> $prio{$a} || $a cmp $b } keys %prio;
+
+unless ($dry_run) {
+	print "$_\n" foreach @order;
+	exit 0;
+}
+
+# only packages built in the profiled run take part in the simulation
+my @built = grep { defined $duration{$_} } @order;
+my $total = 0;
+$total += $duration{$_} foreach @built;
+
+my $default = simulate(sort @built);
+my $scheduled = simulate(@built);
+my @path = ($built[0]);
+while (1) {
+	my ($next) = sort { $prio{$b} <=> $prio{$a} || $a cmp $b }
+		grep { defined $duration{$_} } keys %{$rdeps{$path[-1]} // {}};
+	last unless $next;
+	push @path, $next;
+}
+
+printf "%d packages, %s total build time, %d jobs\n", scalar(@built), fmt_time($total), $jobs;
+printf "Critical path: %s (%s)\n", fmt_time($prio{$built[0]}), join(' -> ', @path);
+printf "Predicted time, default order:  %s\n", fmt_time($default);
+printf "Predicted time, critical first: %s\n", fmt_time($scheduled);
+print "\nStart order:\n";
+printf "  %9s %9s  %s\n", fmt_time($prio{$_}), fmt_time($duration{$_}), $_
+	foreach @built[0 .. ($#built < 19 ? $#built : 19)];
@@ -20,31 +20,75 @@ TARGETS=$*
   exit 1
 }
 
-find $TARGETS -not -path \*/lib/firmware/\* -a -type f -a -exec file {} \; | \
-  sed -n -e 's/^\(.*\):.*ELF.*\(executable\|relocatable\|shared object\).*,.*/\1:\2/p' | \
-(
-  IFS=":"
-  while read F S; do
-    echo "$SELF: $F: $S"
+RSTRIP_JOBS=${RSTRIP_JOBS:-$(nproc 2>/dev/null || echo 1)}
+LIST=$(mktemp)
+trap 'rm -f "$LIST"' EXIT
+
+rstrip_file() {
+	local S="$1" old_rpath="$2" F="$3" new_rpath="" path
+
+	echo "$SELF: $F: $S"
 	[ "${S}" = "relocatable" ] && {
-		[ "${F##*.}" == "o" ] && continue
+		[ "${F##*.}" == "o" ] && return 0
 		eval "$STRIP_KMOD $F"
 	} || {
-		b=$(stat -c '%a' $F)
-		[ -z "$PATCHELF" ] || [ -z "$TOPDIR" ] || {
-			old_rpath="$($PATCHELF --print-rpath $F)"; new_rpath=""
+		[ -z "$PATCHELF" ] || [ -z "$TOPDIR" ] || [ -z "$old_rpath" ] || {
+			local IFS=":"
+			set -f
 			for path in $old_rpath; do
 				case "$path" in
 					/lib/[^/]*|/usr/lib/[^/]*|\$ORIGIN/*|\$ORIGIN) new_rpath="${new_rpath:+$new_rpath:}$path" ;;
 					*) echo "$SELF: $F: removing rpath $path" ;;
 				esac
 			done
+			set +f
+			unset IFS
 			[ "$new_rpath" = "$old_rpath" ] || $PATCHELF --set-rpath "$new_rpath" $F
 		}
 		eval "$STRIP $F"
-		a=$(stat -c '%a' $F)
-		[ "$a" = "$b" ] || chmod $b $F
 	}
-  done
-  true
-)
+	true
+}
+
+START=$(date +%s)
+find $TARGETS -not -path \*/lib/firmware/\* -a -type f -print0 | \
+  "${0%/*}/elf-info.pl" > "$LIST"
+
+# wait -n needs bash 4.3, older versions wait for the whole batch
+[ "${BASH_VERSINFO[0]}" -gt 4 ] || [ "${BASH_VERSINFO[0]}" -eq 4 -a "${BASH_VERSINFO[1]}" -ge 3 ] && \
+	WAIT_ANY=1 || WAIT_ANY=
+
+# one strip per file, run in a bounded pool
+running=0
+while IFS=$'\x1f' read -r S M Z R F; do
+	[ "$running" -lt "$RSTRIP_JOBS" ] || {
+		if [ -n "$WAIT_ANY" ]; then
+			wait -n
+			running=$((running - 1))
+		else
+			wait
+			running=0
+		fi
+	}
+	rstrip_file "$S" "$R" "$F" &
+	running=$((running + 1))
+done < "$LIST"
+wait
+
+# restore permissions changed by strip and report the savings
+perl -e '
+	my ($self, $start) = @ARGV[0, 1];
+	my ($n, $before, $after) = (0, 0, 0);
+	open my $fh, "<", $ARGV[2] or exit 0;
+	while (<$fh>) {
+		chomp;
+		my ($type, $mode, $size, $rpath, $file) = split /\x1f/, $_, 5;
+		my @st = stat($file) or next;
+		chmod oct($mode), $file if ($st[2] & 07777) != oct($mode);
+		$n++;
+		$before += $size;
+		$after += $st[7];
+	}
+	printf "%s: %d files, %d -> %d bytes, saved %d bytes in %ds\n",
+		$self, $n, $before, $after, $before - $after, time() - $start if $n;
+' "$SELF" "$START" "$LIST"
@@ -3,11 +3,19 @@
 use strict;
 use warnings;
 use Config;
+use Fcntl qw(:flock);
+use File::Basename qw(dirname);
+use File::Path qw(make_path);
 
 if (@ARGV < 2) {
-	die "Usage: $0 <prefix> <command...>\n";
+	die "Usage: $0 <prefix> <command...>\n" .
+	    "       $0 --mark <step> <phase> <start|end>\n";
 }
 
+# With BUILD_PROFILE_LOG set, every timed step (and phase mark) is also
+# appended to that file as one JSON object per line, see build-profile.pl
+my $profile_log = $ENV{BUILD_PROFILE_LOG};
+
 sub gettime {
 	my ($sec, $usec);
 
@@ -31,7 +39,70 @@ sub gettime {
 	return ($sec, $usec);
 }
 
+# peak RSS in KiB of the largest waited for child process
+sub child_maxrss {
+	my $long = $Config{'longsize'} == 8 ? 'q' : 'l';
+	my $ru = "\0" x (18 * $Config{'longsize'});
+	my $res;
+
+	eval {
+		require 'syscall.ph';
+		$res = syscall(SYS_getrusage(), -1, $ru);
+	};
+	return undef unless defined($res) && $res == 0;
+
+	# ru_maxrss follows the two struct timeval members
+	return unpack("x" . (4 * $Config{'longsize'}) . $long, $ru);
+}
+
+sub ccache_stats {
+	my $file = shift;
+	my ($hit, $miss) = (0, 0);
+
+	open my $fh, '<', $file or return (0, 0);
+	while (<$fh>) {
+		$hit++ if /cache_hit$/;
+		$miss++ if /^cache_miss$/;
+	}
+	close $fh;
+	unlink $file;
+
+	return ($hit, $miss);
+}
+
+sub json_str {
+	my $str = shift;
+
+	$str =~ s/(["\\])/\\$1/g;
+	$str =~ s/([\x00-\x1f])/sprintf("\\u%04x", ord($1))/ge;
+	return "\"$str\"";
+}
+
+sub profile_write {
+	my %data = @_;
+	my $fh;
+
+	make_path(dirname($profile_log));
+	open $fh, '>>', $profile_log or return;
+	flock($fh, LOCK_EX);
+	print $fh "{" . join(",", map {
+		json_str($_) . ":" . ($data{$_} =~ /^-?[0-9.]+$/ ? $data{$_} : json_str($data{$_}))
+	} grep { defined $data{$_} } sort keys %data) . "}\n";
+	close $fh;
+}
+
+if ($ARGV[0] eq '--mark') {
+	my (undef, $step, $phase, $event) = @ARGV;
+	my ($sec, $usec) = gettime();
+
+	exit 0 unless $profile_log;
+	profile_write(step => $step, phase => $phase, event => $event,
+		      time => sprintf("%.3f", $sec + $usec / 1000000));
+	exit 0;
+}
+
 my ($prefix, @cmd) = @ARGV;
+my $ccache_log = $profile_log ? "$profile_log.ccache.$$" : undef;
 my ($sec, $usec) = gettime();
 my $pid = fork();
 
@@ -39,6 +110,7 @@ if (!defined($pid)) {
 	die "$0: Failure to fork(): $!\n";
 }
 elsif ($pid == 0) {
+	$ENV{'CCACHE_STATSLOG'} = $ccache_log if $ccache_log;
 	exec(@cmd);
 	die "$0: Failure to exec(): $!\n";
 }
@@ -58,6 +130,26 @@ else {
 		$prefix, $cuser, $csystem,
 		($sec2 - $sec) + ($usec2 - $usec) / 1000000;
 
+	if ($profile_log) {
+		my ($hit, $miss) = ccache_stats($ccache_log);
+		my $wall = ($sec2 - $sec) + ($usec2 - $usec) / 1000000;
+		my $step = $prefix;
+
+		$step =~ s/^time: //;
+		profile_write(
+			step => $step,
+			start => sprintf("%.3f", $sec + $usec / 1000000),
+			end => sprintf("%.3f", $sec2 + $usec2 / 1000000),
+			user => sprintf("%.2f", $cuser),
+			sys => sprintf("%.2f", $csystem),
+			cores => sprintf("%.2f", $wall > 0 ? ($cuser + $csystem) / $wall : 0),
+			maxrss => child_maxrss(),
+			ccache_hit => $hit,
+			ccache_miss => $miss,
+			status => $exitcode,
+		);
+	}
+
 	$SIG{'INT'} = 'DEFAULT';
 	$SIG{'QUIT'} = 'DEFAULT';
 
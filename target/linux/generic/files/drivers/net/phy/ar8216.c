@@ -2492,6 +2492,9 @@ ar8xxx_check_link_states(struct ar8xxx_priv *priv)
 
 	mutex_unlock(&priv->reg_mutex);
 
+	if (changed)
+		switch_port_link_changed(&priv->dev);
+
 	return changed;
 }
 
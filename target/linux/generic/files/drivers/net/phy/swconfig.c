@@ -1187,6 +1187,13 @@ unregister_switch(struct switch_dev *dev)
 }
 EXPORT_SYMBOL_GPL(unregister_switch);
 
+void
+switch_port_link_changed(struct switch_dev *dev)
+{
+	swconfig_led_link_changed(dev);
+}
+EXPORT_SYMBOL_GPL(switch_port_link_changed);
+
 int
 switch_generic_set_link(struct switch_dev *dev, int port,
 			struct switch_port_link *link)
@@ -1227,15 +1234,24 @@ EXPORT_SYMBOL_GPL(switch_generic_set_link);
 static int __init
 swconfig_init(void)
 {
+	int err;
+
 	INIT_LIST_HEAD(&swdevs);
 
-	return genl_register_family(&switch_fam);
+	swconfig_leds_init();
+
+	err = genl_register_family(&switch_fam);
+	if (err)
+		swconfig_leds_exit();
+
+	return err;
 }
 
 static void __exit
 swconfig_exit(void)
 {
 	genl_unregister_family(&switch_fam);
+	swconfig_leds_exit();
 }
 
 module_init(swconfig_init);
@@ -14,10 +14,13 @@
 
 #include <linux/leds.h>
 #include <linux/ctype.h>
+#include <linux/debugfs.h>
 #include <linux/device.h>
+#include <linux/seq_file.h>
 #include <linux/workqueue.h>
 
 #define SWCONFIG_LED_TIMER_INTERVAL	(HZ / 10)
+#define SWCONFIG_LED_IDLE_INTERVAL	HZ
 #define SWCONFIG_LED_NUM_PORTS		32
 
 #define SWCONFIG_LED_PORT_SPEED_NA	0x01	/* unknown speed */
@@ -43,13 +46,30 @@ struct switch_led_trigger {
 	struct switch_dev *swdev;
 
 	struct delayed_work sw_led_work;
+	unsigned long interval;
+	bool link_event;
 	u32 port_mask;
+	u32 traffic_mask;
 	u32 port_link;
 	unsigned long long port_tx_traffic[SWCONFIG_LED_NUM_PORTS];
 	unsigned long long port_rx_traffic[SWCONFIG_LED_NUM_PORTS];
 	u8 link_speed[SWCONFIG_LED_NUM_PORTS];
+
+	/* driver callback statistics, see debugfs */
+	struct dentry *debugfs;
+	unsigned long link_reads;
+	unsigned long stats_reads;
+	unsigned long link_events;
+	unsigned long rate_start;
+	unsigned long rate_ops;
+	unsigned long ops_rate;
 };
 
+static struct dentry *swconfig_led_debugfs_dir;
+
+/* protects swdev->led_trigger against switch_port_link_changed() */
+static DEFINE_SPINLOCK(swconfig_led_trig_lock);
+
 struct swconfig_trig_data {
 	struct led_classdev *led_cdev;
 	struct switch_dev *swdev;
@@ -77,7 +97,7 @@ swconfig_trig_update_port_mask(struct led_trigger *trigger)
 {
 	struct list_head *entry;
 	struct switch_led_trigger *sw_trig;
-	u32 port_mask;
+	u32 port_mask, traffic_mask;
 
 	if (!trigger)
 		return;
@@ -85,6 +105,7 @@ swconfig_trig_update_port_mask(struct led_trigger *trigger)
 	sw_trig = (void *) trigger;
 
 	port_mask = 0;
+	traffic_mask = 0;
 	spin_lock(&trigger->leddev_list_lock);
 	list_for_each(entry, &trigger->led_cdevs) {
 		struct led_classdev *led_cdev;
@@ -95,16 +116,20 @@ swconfig_trig_update_port_mask(struct led_trigger *trigger)
 		if (trig_data) {
 			read_lock(&trig_data->lock);
 			port_mask |= trig_data->port_mask;
+			if (trig_data->mode & SWCONFIG_LED_MODE_TXRX)
+				traffic_mask |= trig_data->port_mask;
 			read_unlock(&trig_data->lock);
 		}
 	}
 	spin_unlock(&trigger->leddev_list_lock);
 
 	sw_trig->port_mask = port_mask;
+	sw_trig->traffic_mask = traffic_mask;
+	sw_trig->interval = SWCONFIG_LED_TIMER_INTERVAL;
 
 	if (port_mask)
-		schedule_delayed_work(&sw_trig->sw_led_work,
-				      SWCONFIG_LED_TIMER_INTERVAL);
+		mod_delayed_work(system_wq, &sw_trig->sw_led_work,
+				 SWCONFIG_LED_TIMER_INTERVAL);
 	else
 		cancel_delayed_work_sync(&sw_trig->sw_led_work);
 }
@@ -235,6 +260,7 @@ static ssize_t swconfig_trig_mode_store(struct device *dev,
 	char copybuf[128];
 	int new_mode = -1;
 	char *p, *token;
+	bool changed;
 
 	/* take a copy since we don't want to trash the inbound buffer when using strsep */
 	strncpy(copybuf, buf, sizeof(copybuf));
@@ -264,9 +290,14 @@ static ssize_t swconfig_trig_mode_store(struct device *dev,
 		return -EINVAL;
 
 	write_lock(&trig_data->lock);
+	changed = (trig_data->mode != (u8)new_mode);
 	trig_data->mode = (u8)new_mode;
 	write_unlock(&trig_data->lock);
 
+	/* the counters are only read for ports with tx/rx LEDs */
+	if (changed)
+		swconfig_trig_update_port_mask(led_cdev->trigger);
+
 	return size;
 }
 
@@ -428,21 +459,45 @@ swconfig_trig_update_leds(struct switch_led_trigger *sw_trig)
 	spin_unlock(&trigger->leddev_list_lock);
 }
 
+static void
+swconfig_led_update_rate(struct switch_led_trigger *sw_trig)
+{
+	unsigned long ops = sw_trig->link_reads + sw_trig->stats_reads;
+	unsigned long elapsed = jiffies - sw_trig->rate_start;
+
+	if (elapsed < HZ)
+		return;
+
+	sw_trig->ops_rate = (ops - sw_trig->rate_ops) * HZ / elapsed;
+	sw_trig->rate_start = jiffies;
+	sw_trig->rate_ops = ops;
+}
+
 static void
 swconfig_led_work_func(struct work_struct *work)
 {
 	struct switch_led_trigger *sw_trig;
 	struct switch_dev *swdev;
-	u32 port_mask;
+	u32 port_mask, traffic_mask;
 	u32 link;
+	bool active;
 	int i;
 
 	sw_trig = container_of(work, struct switch_led_trigger,
 			       sw_led_work.work);
 
 	port_mask = sw_trig->port_mask;
+	traffic_mask = sw_trig->traffic_mask;
 	swdev = sw_trig->swdev;
 
+	if (!port_mask)
+		return;
+
+	/* a link change notified by the driver counts as port activity */
+	active = READ_ONCE(sw_trig->link_event);
+	if (active)
+		WRITE_ONCE(sw_trig->link_event, false);
+
 	link = 0;
 	for (i = 0; i < SWCONFIG_LED_NUM_PORTS; i++) {
 		u32 port_bit;
@@ -458,6 +513,7 @@ swconfig_led_work_func(struct work_struct *work)
 
 			memset(&port_link, '\0', sizeof(port_link));
 			swdev->ops->get_port_link(swdev, i, &port_link);
+			sw_trig->link_reads++;
 
 			if (port_link.link) {
 				link |= port_bit;
@@ -482,28 +538,83 @@ swconfig_led_work_func(struct work_struct *work)
 			}
 		}
 
-		if (swdev->ops->get_port_stats) {
+		/* only LEDs in tx/rx mode need the traffic counters */
+		if ((traffic_mask & port_bit) && swdev->ops->get_port_stats) {
 			struct switch_port_stats port_stats;
 
 			memset(&port_stats, '\0', sizeof(port_stats));
 			swdev->ops->get_port_stats(swdev, i, &port_stats);
+			sw_trig->stats_reads++;
+
+			if (port_stats.tx_bytes != sw_trig->port_tx_traffic[i] ||
+			    port_stats.rx_bytes != sw_trig->port_rx_traffic[i])
+				active = true;
+
 			sw_trig->port_tx_traffic[i] = port_stats.tx_bytes;
 			sw_trig->port_rx_traffic[i] = port_stats.rx_bytes;
 		}
 	}
 
+	if (link != sw_trig->port_link)
+		active = true;
+
 	sw_trig->port_link = link;
 
 	swconfig_trig_update_leds(sw_trig);
 
-	schedule_delayed_work(&sw_trig->sw_led_work,
-			      SWCONFIG_LED_TIMER_INTERVAL);
+	/*
+	 * Back off up to SWCONFIG_LED_IDLE_INTERVAL while there is no link
+	 * change or traffic on the monitored ports, to save bus accesses on
+	 * idle switches. Drivers calling switch_port_link_changed() still
+	 * get their link changes shown immediately.
+	 */
+	if (active)
+		sw_trig->interval = SWCONFIG_LED_TIMER_INTERVAL;
+	else
+		sw_trig->interval = min_t(unsigned long, sw_trig->interval * 2,
+					  SWCONFIG_LED_IDLE_INTERVAL);
+
+	swconfig_led_update_rate(sw_trig);
+
+	schedule_delayed_work(&sw_trig->sw_led_work, sw_trig->interval);
 }
 
+static void
+swconfig_led_link_changed(struct switch_dev *swdev)
+{
+	struct switch_led_trigger *sw_trig;
+	unsigned long flags;
+
+	spin_lock_irqsave(&swconfig_led_trig_lock, flags);
+	sw_trig = swdev->led_trigger;
+	if (sw_trig && sw_trig->port_mask) {
+		sw_trig->link_events++;
+		WRITE_ONCE(sw_trig->link_event, true);
+		mod_delayed_work(system_wq, &sw_trig->sw_led_work, 0);
+	}
+	spin_unlock_irqrestore(&swconfig_led_trig_lock, flags);
+}
+
+static int
+swconfig_led_stats_show(struct seq_file *s, void *data)
+{
+	struct switch_led_trigger *sw_trig = s->private;
+
+	seq_printf(s, "interval_ms: %u\n", jiffies_to_msecs(sw_trig->interval));
+	seq_printf(s, "link_reads: %lu\n", sw_trig->link_reads);
+	seq_printf(s, "stats_reads: %lu\n", sw_trig->stats_reads);
+	seq_printf(s, "reads_per_sec: %lu\n", sw_trig->ops_rate);
+	seq_printf(s, "link_events: %lu\n", sw_trig->link_events);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(swconfig_led_stats);
+
 static int
 swconfig_create_led_trigger(struct switch_dev *swdev)
 {
 	struct switch_led_trigger *sw_trig;
+	unsigned long flags;
 	int err;
 
 	if (!swdev->ops->get_port_link)
@@ -514,6 +625,8 @@ swconfig_create_led_trigger(struct switch_dev *swdev)
 		return -ENOMEM;
 
 	sw_trig->swdev = swdev;
+	sw_trig->interval = SWCONFIG_LED_TIMER_INTERVAL;
+	sw_trig->rate_start = jiffies;
 	sw_trig->trig.name = swdev->devname;
 	sw_trig->trig.activate = swconfig_trig_activate;
 	sw_trig->trig.deactivate = swconfig_trig_deactivate;
@@ -524,7 +637,14 @@ swconfig_create_led_trigger(struct switch_dev *swdev)
 	if (err)
 		goto err_free;
 
+	spin_lock_irqsave(&swconfig_led_trig_lock, flags);
 	swdev->led_trigger = sw_trig;
+	spin_unlock_irqrestore(&swconfig_led_trig_lock, flags);
+
+	sw_trig->debugfs = debugfs_create_file(swdev->devname, 0400,
+					       swconfig_led_debugfs_dir,
+					       sw_trig,
+					       &swconfig_led_stats_fops);
 
 	return 0;
 
@@ -537,19 +657,48 @@ static void
 swconfig_destroy_led_trigger(struct switch_dev *swdev)
 {
 	struct switch_led_trigger *sw_trig;
+	unsigned long flags;
 
+	/* no link change notification can queue the work after this */
+	spin_lock_irqsave(&swconfig_led_trig_lock, flags);
 	sw_trig = swdev->led_trigger;
+	swdev->led_trigger = NULL;
+	spin_unlock_irqrestore(&swconfig_led_trig_lock, flags);
+
 	if (sw_trig) {
-		cancel_delayed_work_sync(&sw_trig->sw_led_work);
+		debugfs_remove(sw_trig->debugfs);
+		/* deactivating the LEDs may still queue the work */
 		led_trigger_unregister(&sw_trig->trig);
+		cancel_delayed_work_sync(&sw_trig->sw_led_work);
 		kfree(sw_trig);
 	}
 }
 
+static void
+swconfig_leds_init(void)
+{
+	swconfig_led_debugfs_dir = debugfs_create_dir("swconfig_leds", NULL);
+}
+
+static void
+swconfig_leds_exit(void)
+{
+	debugfs_remove_recursive(swconfig_led_debugfs_dir);
+}
+
 #else /* SWCONFIG_LEDS */
 static inline int
 swconfig_create_led_trigger(struct switch_dev *swdev) { return 0; }
 
 static inline void
 swconfig_destroy_led_trigger(struct switch_dev *swdev) { }
+
+static inline void
+swconfig_led_link_changed(struct switch_dev *swdev) { }
+
+static inline void
+swconfig_leds_init(void) { }
+
+static inline void
+swconfig_leds_exit(void) { }
 #endif /* CONFIG_SWCONFIG_LEDS */
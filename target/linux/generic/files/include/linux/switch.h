@@ -28,6 +28,8 @@ struct switch_led_trigger;
 
 int register_switch(struct switch_dev *dev, struct net_device *netdev);
 void unregister_switch(struct switch_dev *dev);
+/* notify swconfig of a port link change, e.g. to update the port LEDs */
+void switch_port_link_changed(struct switch_dev *dev);
 
 /**
  * struct switch_attrlist - attribute list
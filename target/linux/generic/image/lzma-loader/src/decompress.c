@@ -32,6 +32,10 @@
  *
  * ??-Nov-2005 Mike Baker
  *   reorder the script as an lzma wrapper; do not depend on flash access
+ *
+ * The compressed kernel is linked into the loader, so the whole stream is
+ * handed to the decoder at once instead of feeding it through a per-byte
+ * input callback.
  */
 
 #include "LzmaDecode.h"
@@ -80,20 +84,9 @@ static __inline__ void blast_dcache(unsigned long size, unsigned long lsize)
 
 unsigned char *data;
 
-static int read_byte(void *object, unsigned char **buffer, UInt32 *bufferSize)
-{
-	*bufferSize = 1;
-	*buffer = data;
-	++data;
-	return LZMA_RESULT_OK;
-}
-
 static __inline__ unsigned char get_byte(void)
 {
-	unsigned char *buffer;
-	UInt32 fake;
-
-	return read_byte(0, &buffer, &fake), *buffer;
+	return *data++;
 }
 
 /* This puts lzma workspace 128k below RAM end.
@@ -109,6 +102,7 @@ void entry(unsigned long icache_size, unsigned long icache_lsize,
 {
 	unsigned int i;  /* temp value */
 	unsigned int osize; /* uncompressed size */
+	SizeT isize; /* compressed bytes consumed */
 	volatile unsigned int arg0, arg1, arg2, arg3;
 
 	/* restore argument registers */
@@ -117,9 +111,7 @@ void entry(unsigned long icache_size, unsigned long icache_lsize,
 	__asm__ __volatile__ ("ori %0, $14, 0":"=r"(arg2));
 	__asm__ __volatile__ ("ori %0, $15, 0":"=r"(arg3));
 
-	ILzmaInCallback callback;
 	CLzmaDecoderState vs;
-	callback.Read = read_byte;
 
 	data = lzma_start;
 
@@ -145,7 +137,7 @@ void entry(unsigned long icache_size, unsigned long icache_lsize,
 		get_byte();
 
 	/* decompress kernel */
-	if ((i = LzmaDecode(&vs, &callback,
+	if ((i = LzmaDecode(&vs, data, lzma_end - (char *)data, &isize,
 	(unsigned char*)KERNEL_ENTRY, osize, &osize)) == LZMA_RESULT_OK)
 	{
 		blast_dcache(dcache_size, dcache_lsize);
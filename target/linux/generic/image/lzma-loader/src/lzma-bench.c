@@ -0,0 +1,184 @@
+/*
+ * Host side benchmark for the lzma-loader decoder
+ *
+ * Runs the LzmaDecode.c used by the boot loader against a real kernel image
+ * (as produced by "lzma e") and reports the decompression throughput, so
+ * boot time regressions in the decoder show up without target hardware.
+ *
+ * Build with "make lzma-bench" in this directory. LZMA_SRC selects the
+ * decoder to test, e.g. LZMA_SRC=../../../../ath79/image/lzma-loader/src.
+ * "make lzma-bench-cb" builds the same harness against the per-byte input
+ * callback interface previously used by this loader, for comparison.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "LzmaDecode.h"
+
+#define LZMA_HEADER_SIZE	13
+
+#ifdef _LZMA_IN_CB
+static const unsigned char *cb_data;
+
+static int read_byte(void *object, const unsigned char **buffer, SizeT *bufferSize)
+{
+	*bufferSize = 1;
+	*buffer = cb_data++;
+	return LZMA_RESULT_OK;
+}
+#endif
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned char *read_file(const char *name, size_t *size)
+{
+	unsigned char *buf = NULL;
+	size_t len = 0, n;
+	FILE *f;
+
+	f = fopen(name, "rb");
+	if (!f)
+		return NULL;
+
+	do {
+		buf = realloc(buf, len + 65536);
+		if (!buf)
+			break;
+		n = fread(buf + len, 1, 65536, f);
+		len += n;
+	} while (n > 0);
+
+	fclose(f);
+	*size = len;
+	return buf;
+}
+
+static int decode(CLzmaDecoderState *vs, const unsigned char *in, size_t isize,
+		  unsigned char *out, SizeT osize, SizeT *op)
+{
+#ifdef _LZMA_IN_CB
+	ILzmaInCallback callback = { .Read = read_byte };
+
+	cb_data = in;
+	return LzmaDecode(vs, &callback, out, osize, op);
+#else
+	SizeT ip;
+
+	return LzmaDecode(vs, in, isize, &ip, out, osize, op);
+#endif
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-n <iterations>] [-o <output>] <file.lzma>\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	CLzmaDecoderState vs;
+	const char *outname = NULL;
+	unsigned char *in, *out;
+	size_t isize;
+	SizeT osize, op;
+	double start, best = 0, total = 0;
+	int iterations = 5;
+	int ch, i, res;
+
+	while ((ch = getopt(argc, argv, "n:o:")) != -1) {
+		switch (ch) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'o':
+			outname = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc - 1 || iterations < 1)
+		usage(argv[0]);
+
+	in = read_file(argv[optind], &isize);
+	if (!in || isize < LZMA_HEADER_SIZE) {
+		fprintf(stderr, "Failed to read %s\n", argv[optind]);
+		return 1;
+	}
+
+	/* same header parsing as the loader */
+	i = in[0];
+	if (i >= 9 * 5 * 5) {
+		fprintf(stderr, "Incorrect LZMA stream properties\n");
+		return 1;
+	}
+	vs.Properties.lc = i % 9, i = i / 9;
+	vs.Properties.lp = i % 5, vs.Properties.pb = i / 5;
+
+	osize = in[5] | (in[6] << 8) | (in[7] << 16) | ((SizeT)in[8] << 24);
+	if (osize == (SizeT)-1) {
+		fprintf(stderr, "Uncompressed size missing from header\n");
+		return 1;
+	}
+
+	vs.Probs = malloc(LzmaGetNumProbs(&vs.Properties) * sizeof(CProb));
+	out = malloc(osize);
+	if (!vs.Probs || !out) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	for (i = 0; i < iterations; i++) {
+		double t;
+
+		start = now();
+		res = decode(&vs, in + LZMA_HEADER_SIZE, isize - LZMA_HEADER_SIZE,
+			     out, osize, &op);
+		t = now() - start;
+
+		if (res != LZMA_RESULT_OK || op != osize) {
+			fprintf(stderr, "LzmaDecode failed: %d (%lu of %lu bytes)\n",
+				res, (unsigned long)op, (unsigned long)osize);
+			return 1;
+		}
+
+		total += t;
+		if (!best || t < best)
+			best = t;
+	}
+
+	printf("%s: %lu -> %lu bytes, lc=%d lp=%d pb=%d\n", argv[optind],
+	       (unsigned long)isize, (unsigned long)osize,
+	       vs.Properties.lc, vs.Properties.lp, vs.Properties.pb);
+	printf("%d runs: best %.3fs (%.1f MB/s), avg %.3fs (%.1f MB/s)\n",
+	       iterations, best, osize / best / 1e6,
+	       total / iterations, osize / (total / iterations) / 1e6);
+
+	if (outname) {
+		FILE *f = fopen(outname, "wb");
+
+		if (!f || fwrite(out, 1, osize, f) != osize) {
+			fprintf(stderr, "Failed to write %s\n", outname);
+			return 1;
+		}
+		fclose(f);
+	}
+
+	return 0;
+}